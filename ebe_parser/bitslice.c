@@ -0,0 +1,454 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "bitslice.h"
+#include "program.h"
+#include "log.h"
+
+// Column of the lowest six bits of the assignment index within a word.
+// Bit j of bitslice_patterns[s] is bit s of j.
+static const uint64_t bitslice_patterns[6] =
+{
+	0xAAAAAAAAAAAAAAAAULL,
+	0xCCCCCCCCCCCCCCCCULL,
+	0xF0F0F0F0F0F0F0F0ULL,
+	0xFF00FF00FF00FF00ULL,
+	0xFFFF0000FFFF0000ULL,
+	0xFFFFFFFF00000000ULL
+};
+
+// Plane t of a value stored in planes starting at x. Registers and scratch
+// values all use the same plane stride.
+#define PLANE(x, t) ((x) + (size_t)(t) * BITSLICE_WORDS)
+
+int bitslice_supports(program* p)
+{
+	return p->bits >= 1 && p->bits <= BITSLICE_MAX_BITS && !program_uses_user_operators(p);
+}
+
+// Fills words with the column for bit shift of the assignment index, for
+// the block of assignments beginning at base.
+static void load_column(uint64_t* dst, size_t words, uint32_t shift, uint64_t base)
+{
+	size_t w;
+
+	for (w=0; w<words; w++)
+	{
+		if (shift < 6)
+		{
+			dst[w] = bitslice_patterns[shift];
+		}
+		else
+		{
+			dst[w] = ((base + 64 * w) >> shift) & 1 ? ~0ULL : 0;
+		}
+	}
+}
+
+// One bit variables reduce the arithmetic operators to bitwise ones:
+// + and - are ^, * is &, shifting by one clears the value, unary minus does
+// nothing, a divide is the dividend and a modulus is zero. Divide and modulus
+// by zero set the nan column.
+static void run_block_1bit(program* p, uint64_t* regs, uint64_t* nan_words, size_t words, uint64_t block)
+{
+	uint64_t* r;
+	uint64_t* a;
+	uint64_t* b;
+	size_t i, w;
+	instruction* in;
+
+	for (i=0; i<p->length; i++)
+	{
+		in = &p->code[i];
+		r = regs + i * BITSLICE_WORDS;
+		a = regs + in->a * BITSLICE_WORDS;
+		b = regs + in->b * BITSLICE_WORDS;
+
+		switch (in->op)
+		{
+			case op_const:
+				for (w=0; w<words; w++) r[w] = in->a & 1 ? ~0ULL : 0;
+				break;
+			case op_var:
+				load_column(r, words, (uint32_t)(p->variable_count - 1 - in->a), block);
+				break;
+			case op_mul:
+			case op_and:
+				for (w=0; w<words; w++) r[w] = a[w] & b[w];
+				break;
+			case op_div:
+				for (w=0; w<words; w++) { nan_words[w] |= ~b[w]; r[w] = a[w] & b[w]; }
+				break;
+			case op_mod:
+				for (w=0; w<words; w++) { nan_words[w] |= ~b[w]; r[w] = 0; }
+				break;
+			case op_add:
+			case op_sub:
+			case op_xor:
+				for (w=0; w<words; w++) r[w] = a[w] ^ b[w];
+				break;
+			case op_shl:
+			case op_shr:
+				for (w=0; w<words; w++) r[w] = a[w] & ~b[w];
+				break;
+			case op_or:
+				for (w=0; w<words; w++) r[w] = a[w] | b[w];
+				break;
+			case op_minus:
+				for (w=0; w<words; w++) r[w] = a[w];
+				break;
+			case op_negate:
+				for (w=0; w<words; w++) r[w] = ~a[w];
+				break;
+			default:
+				for (w=0; w<words; w++) r[w] = 0;
+				break;
+		}
+	}
+}
+
+// Ripple carry adder over bits planes: r = a + b, or r = a - b (a + ~b + 1)
+// when subtract is set. carry holds the carry out of the top plane when done,
+// for a subtract that is set where a >= b. r may be the same as a or b.
+static void plane_add(uint64_t* r, const uint64_t* a, const uint64_t* b, uint32_t bits,
+	size_t words, int subtract, uint64_t* carry)
+{
+	const uint64_t* ap;
+	const uint64_t* bp;
+	uint64_t* rp;
+	uint64_t x, y, s;
+	uint32_t t;
+	size_t w;
+
+	for (w=0; w<words; w++)
+	{
+		carry[w] = subtract ? ~0ULL : 0;
+	}
+
+	for (t=0; t<bits; t++)
+	{
+		ap = PLANE(a, t);
+		bp = PLANE(b, t);
+		rp = PLANE(r, t);
+
+		for (w=0; w<words; w++)
+		{
+			x = ap[w];
+			y = subtract ? ~bp[w] : bp[w];
+			s = x ^ y;
+			rp[w] = s ^ carry[w];
+			carry[w] = (x & y) | (carry[w] & s);
+		}
+	}
+}
+
+// Shift-and-add multiplier, r = a * b over bits planes
+static void plane_mul(uint64_t* r, const uint64_t* a, const uint64_t* b, uint32_t bits,
+	size_t words, uint64_t* partial, uint64_t* carry)
+{
+	uint32_t t, u;
+	size_t w;
+	const uint64_t* sel;
+
+	memset(r, 0, sizeof(uint64_t) * BITSLICE_WORDS * bits);
+
+	for (t=0; t<bits; t++)
+	{
+		// partial = (a << t) where bit t of b is set
+		sel = PLANE(b, t);
+
+		for (u=0; u<bits; u++)
+		{
+			for (w=0; w<words; w++)
+			{
+				PLANE(partial, u)[w] = u >= t ? PLANE(a, u - t)[w] & sel[w] : 0;
+			}
+		}
+
+		plane_add(r, r, partial, bits, words, 0, carry);
+	}
+}
+
+// Barrel shifter, r = a << b (left set) or a >> b over bits planes. Shifting
+// by bits or more clears the value.
+static void plane_shift(uint64_t* r, const uint64_t* a, const uint64_t* b, uint32_t bits,
+	size_t words, int left)
+{
+	uint32_t t, u, k;
+	uint64_t amount;
+	size_t w;
+	const uint64_t* sel;
+	uint64_t src;
+
+	memcpy(r, a, sizeof(uint64_t) * BITSLICE_WORDS * bits);
+
+	for (t=0; t<bits; t++)
+	{
+		sel = PLANE(b, t);
+		amount = 1ULL << t;
+
+		for (k=0; k<bits; k++)
+		{
+			// walk away from the planes being read so they are still unchanged
+			u = left ? bits - 1 - k : k;
+
+			for (w=0; w<words; w++)
+			{
+				if (left)
+				{
+					src = amount <= u ? PLANE(r, u - amount)[w] : 0;
+				}
+				else
+				{
+					src = u + amount < bits ? PLANE(r, u + amount)[w] : 0;
+				}
+
+				PLANE(r, u)[w] = (sel[w] & src) | (~sel[w] & PLANE(r, u)[w]);
+			}
+		}
+	}
+}
+
+// Restoring divider over bits planes. r is a / b (quotient set) or a % b.
+// Where b is zero nan_words are set, the value in r is meaningless there.
+static void plane_divide(uint64_t* r, const uint64_t* a, const uint64_t* b, uint32_t bits,
+	size_t words, int quotient, uint64_t* scratch, uint64_t* nan_words)
+{
+	// the remainder needs one plane more than the operands before each
+	// compare and subtract
+	uint64_t* rem = scratch;
+	uint64_t* diff = PLANE(rem, bits + 1);
+	uint64_t* divisor = PLANE(diff, bits + 1);
+	uint64_t* carry = PLANE(divisor, bits + 1);
+	uint64_t any;
+	int32_t t;
+	uint32_t u;
+	size_t w;
+
+	memset(rem, 0, sizeof(uint64_t) * BITSLICE_WORDS * (bits + 1));
+	memset(r, 0, sizeof(uint64_t) * BITSLICE_WORDS * bits);
+
+	memcpy(divisor, b, sizeof(uint64_t) * BITSLICE_WORDS * bits);
+	memset(PLANE(divisor, bits), 0, sizeof(uint64_t) * BITSLICE_WORDS);
+
+	for (t=(int32_t)bits - 1; t>=0; t--)
+	{
+		// rem = (rem << 1) | bit t of a
+		for (u=bits; u>0; u--)
+		{
+			memcpy(PLANE(rem, u), PLANE(rem, u - 1), sizeof(uint64_t) * words);
+		}
+		memcpy(PLANE(rem, 0), PLANE(a, t), sizeof(uint64_t) * words);
+
+		// carry is set where rem >= b, keep the difference there
+		plane_add(diff, rem, divisor, bits + 1, words, 1, carry);
+
+		for (u=0; u<bits + 1; u++)
+		{
+			for (w=0; w<words; w++)
+			{
+				PLANE(rem, u)[w] = (carry[w] & PLANE(diff, u)[w]) | (~carry[w] & PLANE(rem, u)[w]);
+			}
+		}
+
+		if (quotient)
+		{
+			memcpy(PLANE(r, t), carry, sizeof(uint64_t) * words);
+		}
+	}
+
+	if (!quotient)
+	{
+		memcpy(r, rem, sizeof(uint64_t) * BITSLICE_WORDS * bits);
+	}
+
+	for (w=0; w<words; w++)
+	{
+		any = 0;
+
+		for (u=0; u<bits; u++)
+		{
+			any |= PLANE(b, u)[w];
+		}
+
+		nan_words[w] |= ~any;
+	}
+}
+
+// Evaluates a program over bits planes per register
+static void run_block_planes(program* p, uint64_t* regs, uint64_t* scratch, uint64_t* nan_words,
+	size_t words, uint64_t block)
+{
+	uint32_t bits = p->bits;
+	size_t stride = (size_t)bits * BITSLICE_WORDS;
+	uint64_t* r;
+	uint64_t* a;
+	uint64_t* b;
+	uint64_t* carry = scratch;
+	uint64_t* partial = PLANE(scratch, 1);
+	uint32_t t;
+	size_t i, w;
+	instruction* in;
+
+	for (i=0; i<p->length; i++)
+	{
+		in = &p->code[i];
+		r = regs + i * stride;
+		a = regs + in->a * stride;
+		b = regs + in->b * stride;
+
+		switch (in->op)
+		{
+			case op_const:
+				for (t=0; t<bits; t++)
+				{
+					for (w=0; w<words; w++) PLANE(r, t)[w] = (in->a >> t) & 1 ? ~0ULL : 0;
+				}
+				break;
+			case op_var:
+				for (t=0; t<bits; t++)
+				{
+					load_column(PLANE(r, t), words, (uint32_t)((p->variable_count - 1 - in->a) * bits + t), block);
+				}
+				break;
+			case op_mul:
+				plane_mul(r, a, b, bits, words, partial, carry);
+				break;
+			case op_div:
+				plane_divide(r, a, b, bits, words, 1, scratch, nan_words);
+				break;
+			case op_mod:
+				plane_divide(r, a, b, bits, words, 0, scratch, nan_words);
+				break;
+			case op_add:
+				plane_add(r, a, b, bits, words, 0, carry);
+				break;
+			case op_sub:
+				plane_add(r, a, b, bits, words, 1, carry);
+				break;
+			case op_shl:
+				plane_shift(r, a, b, bits, words, 1);
+				break;
+			case op_shr:
+				plane_shift(r, a, b, bits, words, 0);
+				break;
+			case op_and:
+				for (w=0; w<stride; w++) r[w] = a[w] & b[w];
+				break;
+			case op_xor:
+				for (w=0; w<stride; w++) r[w] = a[w] ^ b[w];
+				break;
+			case op_or:
+				for (w=0; w<stride; w++) r[w] = a[w] | b[w];
+				break;
+			case op_minus:
+				// 0 - a is ~a + 1
+				for (w=0; w<words; w++) carry[w] = ~0ULL;
+				for (t=0; t<bits; t++)
+				{
+					for (w=0; w<words; w++)
+					{
+						PLANE(r, t)[w] = ~PLANE(a, t)[w] ^ carry[w];
+						carry[w] = ~PLANE(a, t)[w] & carry[w];
+					}
+				}
+				break;
+			case op_negate:
+				for (w=0; w<stride; w++) r[w] = ~a[w];
+				break;
+			default:
+				memset(r, 0, sizeof(uint64_t) * stride);
+				break;
+		}
+	}
+}
+
+void bitslice_run_range(program* p, uint64_t start, uint64_t count, int32_t* values, uint8_t* nan)
+{
+	uint32_t bits = p->bits;
+	uint64_t* regs = (uint64_t*)malloc(sizeof(uint64_t) * BITSLICE_WORDS * bits * p->length);
+	uint64_t* scratch = 0;
+	uint64_t nan_words[BITSLICE_WORDS];
+	uint64_t* result;
+
+	uint64_t block;
+	uint64_t end = start + count;
+	uint64_t remaining;
+	size_t words;
+	uint64_t j;
+	uint32_t t;
+	int32_t v;
+
+	if (regs == 0)
+	{
+		elog(LOG_FATAL_ERROR, "bitslice_run_range: out of memory\n");
+	}
+
+	if (bits > 1)
+	{
+		// carry plus three values of bits + 1 planes, see plane_divide
+		scratch = (uint64_t*)malloc(sizeof(uint64_t) * BITSLICE_WORDS * (3 * (bits + 1) + 1));
+
+		if (scratch == 0)
+		{
+			elog(LOG_FATAL_ERROR, "bitslice_run_range: out of memory 2\n");
+		}
+	}
+
+	if (start % 64 != 0)
+	{
+		elog(LOG_FATAL_ERROR, "bitslice_run_range: start (%d) is not a multiple of 64\n", (int)start);
+	}
+
+	for (block = start; block < end; block += 64 * BITSLICE_WORDS)
+	{
+		remaining = end - block;
+		words = (size_t)((remaining + 63) / 64);
+
+		if (words > BITSLICE_WORDS)
+		{
+			words = BITSLICE_WORDS;
+		}
+
+		memset(nan_words, 0, sizeof(nan_words));
+
+		if (bits == 1)
+		{
+			run_block_1bit(p, regs, nan_words, words, block);
+		}
+		else
+		{
+			run_block_planes(p, regs, scratch, nan_words, words, block);
+		}
+
+		// unpack the result planes
+		result = regs + (p->length - 1) * bits * BITSLICE_WORDS;
+
+		if (remaining > 64 * BITSLICE_WORDS)
+		{
+			remaining = 64 * BITSLICE_WORDS;
+		}
+
+		for (j=0; j<remaining; j++)
+		{
+			v = 0;
+
+			for (t=0; t<bits; t++)
+			{
+				v |= (int32_t)((PLANE(result, t)[j >> 6] >> (j & 63)) & 1) << t;
+			}
+
+			values[block - start + j] = v;
+			nan[block - start + j] = (uint8_t)((nan_words[j >> 6] >> (j & 63)) & 1);
+		}
+	}
+
+	if (scratch != 0)
+	{
+		free(scratch);
+	}
+
+	free(regs);
+}
@@ -0,0 +1,26 @@
+#ifndef __BITSLICE_H__
+#define __BITSLICE_H__
+
+#include <stdint.h>
+
+#include "program.h"
+
+// Number of 64 bit words evaluated per register plane in one pass over a
+// program. Each word holds one bit for 64 consecutive assignments.
+#define BITSLICE_WORDS 16
+
+// Largest number of bits per variable the bit-sliced engine evaluates. The
+// circuits for * and / grow with the square of the number of bits.
+#define BITSLICE_MAX_BITS 16
+
+// Returns 1 if the program can be evaluated bit-sliced, otherwise 0.
+int bitslice_supports(program* p);
+
+// Bit-sliced version of program_run_range. Every register is stored as
+// p->bits bit planes, each plane a bitmask column over the assignment space,
+// so each instruction evaluates 64 assignments per machine word. Arithmetic
+// operators are evaluated as circuits over the planes. start must be a
+// multiple of 64.
+void bitslice_run_range(program* p, uint64_t start, uint64_t count, int32_t* values, uint8_t* nan);
+
+#endif
@@ -0,0 +1,169 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "cache.h"
+#include "log.h"
+
+truth_table* truth_table_init(uint64_t size)
+{
+	truth_table* t = (truth_table*)malloc(sizeof(truth_table));
+
+	if (t == 0)
+	{
+		elog(LOG_FATAL_ERROR, "truth_table_init: out of memory\n");
+	}
+
+	t->values = (int32_t*)malloc(sizeof(int32_t) * size);
+	t->nan = (uint8_t*)malloc(sizeof(uint8_t) * size);
+	t->refs = 1;
+
+	if (t->values == 0 || t->nan == 0)
+	{
+		elog(LOG_FATAL_ERROR, "truth_table_init: out of memory 2\n");
+	}
+
+	return t;
+}
+
+void truth_table_ref(truth_table* t)
+{
+	t->refs++;
+}
+
+void truth_table_release(truth_table* t)
+{
+	if (t == 0)
+	{
+		return;
+	}
+
+	t->refs--;
+
+	if (t->refs == 0)
+	{
+		free(t->values);
+		free(t->nan);
+		free(t);
+	}
+}
+
+table_cache* table_cache_init(size_t max_bytes)
+{
+	table_cache* c = (table_cache*)malloc(sizeof(table_cache));
+
+	if (c == 0)
+	{
+		elog(LOG_FATAL_ERROR, "table_cache_init: out of memory\n");
+	}
+
+	memset(c, 0, sizeof(table_cache));
+	c->max_bytes = max_bytes;
+
+	return c;
+}
+
+static void evict(table_cache* c, cache_entry* e)
+{
+	HASH_DELETE(hh, c->head, e);
+	truth_table_release(e->table);
+
+	c->bytes -= e->bytes;
+
+	free(e);
+}
+
+truth_table* table_cache_find(table_cache* c, cache_key* key)
+{
+	cache_entry* e;
+
+	HASH_FIND(hh, c->head, key, sizeof(cache_key), e);
+
+	if (e == 0)
+	{
+		c->misses++;
+		return 0;
+	}
+
+	// move to the back of the order, the most recently used end
+	HASH_DELETE(hh, c->head, e);
+	HASH_ADD(hh, c->head, key, sizeof(cache_key), e);
+
+	c->hits++;
+
+	return e->table;
+}
+
+void table_cache_add(table_cache* c, cache_key* key, truth_table* t, uint64_t size)
+{
+	cache_entry* e;
+	cache_entry* tmp;
+	size_t bytes = (size_t)size * (sizeof(int32_t) + sizeof(uint8_t));
+
+	if (bytes > c->max_bytes)
+	{
+		return;
+	}
+
+	HASH_FIND(hh, c->head, key, sizeof(cache_key), e);
+
+	if (e != 0)
+	{
+		return;
+	}
+
+	// the front of the order is the least recently used
+	HASH_ITER(hh, c->head, e, tmp)
+	{
+		if (c->bytes + bytes <= c->max_bytes)
+		{
+			break;
+		}
+
+		evict(c, e);
+		c->evictions++;
+	}
+
+	e = (cache_entry*)malloc(sizeof(cache_entry));
+
+	if (e == 0)
+	{
+		elog(LOG_FATAL_ERROR, "table_cache_add: out of memory\n");
+	}
+
+	memset(e, 0, sizeof(cache_entry));
+	e->key = *key;
+	e->table = t;
+	e->bytes = bytes;
+	truth_table_ref(t);
+
+	HASH_ADD(hh, c->head, key, sizeof(cache_key), e);
+
+	c->bytes += bytes;
+}
+
+void printf_table_cache(table_cache* c)
+{
+	elog(LOG_NORMAL, "cache: %llu hits, %llu misses, %llu evictions, %u tables, %llu of %llu bytes\n",
+		(unsigned long long)c->hits, (unsigned long long)c->misses, (unsigned long long)c->evictions,
+		(unsigned int)HASH_COUNT(c->head), (unsigned long long)c->bytes, (unsigned long long)c->max_bytes);
+}
+
+void table_cache_free(table_cache* c)
+{
+	cache_entry* e;
+	cache_entry* tmp;
+
+	if (c == 0)
+	{
+		return;
+	}
+
+	HASH_ITER(hh, c->head, e, tmp)
+	{
+		evict(c, e);
+	}
+
+	free(c);
+}
@@ -0,0 +1,95 @@
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+// uthash is used for the lookup, and its insertion order list as the
+// least recently used order
+#include "uthash.h"
+
+// default memory limit of the subtree cache, in bytes
+#define TABLE_CACHE_DEFAULT_BYTES ((size_t)256 << 20)
+
+// Truth table of a subtree: the value and nan for every assignment index.
+// Tables are shared between a session and the cache, and freed when the
+// last reference is released.
+typedef struct truth_table
+{
+	int32_t* values;
+	uint8_t* nan;
+
+	// number of references
+	uint32_t refs;
+
+} truth_table;
+
+// Structural hash of a subtree. Two independent 64 bit hashes, so
+// different subtrees colliding is not a practical concern.
+typedef struct cache_key
+{
+	uint64_t h1;
+	uint64_t h2;
+
+} cache_key;
+
+typedef struct cache_entry
+{
+	cache_key key;
+
+	truth_table* table;
+
+	// memory used by the table
+	size_t bytes;
+
+	// internal hash handle; required
+	UT_hash_handle hh;
+
+} cache_entry;
+
+// Bounded cache from the structural hash of a subtree to its truth table.
+// The number of bits and variables are part of the hash, so tables of
+// different sizes live side by side. When full the least recently used
+// tables are evicted.
+typedef struct table_cache
+{
+	// hash, in least recently used order
+	cache_entry* head;
+
+	// memory limit, and memory used by the cached tables
+	size_t max_bytes;
+	size_t bytes;
+
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+
+} table_cache;
+
+// Allocates a table for size assignments, with one reference
+truth_table* truth_table_init(uint64_t size);
+
+// Adds a reference to a table
+void truth_table_ref(truth_table* t);
+
+// Releases a reference to a table, freeing it with the last one
+void truth_table_release(truth_table* t);
+
+// Mallocs a new cache holding up to max_bytes of tables
+table_cache* table_cache_init(size_t max_bytes);
+
+// Returns the cached table for a subtree, or 0. The table is borrowed; add a
+// reference to keep it.
+truth_table* table_cache_find(table_cache* c, cache_key* key);
+
+// Adds the table of a subtree, size assignments long, evicting the least
+// recently used tables when over the memory limit.
+void table_cache_add(table_cache* c, cache_key* key, truth_table* t, uint64_t size);
+
+// Prints the hit, miss and eviction counters, LOG_NORMAL
+void printf_table_cache(table_cache* c);
+
+// Frees a cache, releasing its tables
+void table_cache_free(table_cache* c);
+
+#endif
@@ -0,0 +1,502 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "cost.h"
+#include "log.h"
+
+// first line of the cost model file, changed whenever the format or the
+// calibration programs change
+#define COST_MODEL_HEADER "ebe cost model 1"
+
+#define COST_NAME_SIZE 64
+
+// calibration of one engine at one width, in nanoseconds
+typedef struct cost_entry
+{
+	char name[COST_NAME_SIZE];
+	uint32_t bits;
+
+	// per assignment, on top of the instructions
+	double fixed;
+
+	// per assignment and instruction of each class
+	double op[COST_CLASSES];
+
+	// per instruction, once for a program
+	double prepare;
+
+} cost_entry;
+
+typedef struct cost_model
+{
+	cost_entry* entries;
+	size_t count;
+	size_t capacity;
+
+	// 1 once the file was read
+	int loaded;
+
+} cost_model;
+
+static cost_model model = { 0, 0, 0, 0 };
+
+static const uint32_t calibrated_bits[] = COST_CALIBRATED_BITS;
+
+static double now_ns()
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+
+	return (double)t.tv_sec * 1e9 + (double)t.tv_nsec;
+}
+
+// mallocs the path of the cost model file, or returns 0 without a home
+static char* model_path()
+{
+	char* home = getenv("HOME");
+	char* path;
+
+	if (home == 0 || *home == 0)
+	{
+		return 0;
+	}
+
+	path = (char*)malloc(strlen(home) + strlen(COST_MODEL_FILE) + 2);
+
+	if (path == 0)
+	{
+		elog(LOG_FATAL_ERROR, "model_path: out of memory\n");
+	}
+
+	sprintf(path, "%s/%s", home, COST_MODEL_FILE);
+
+	return path;
+}
+
+static cost_entry* find_entry(char* name, uint32_t bits)
+{
+	size_t i;
+
+	for (i=0; i<model.count; i++)
+	{
+		if (model.entries[i].bits == bits && strcmp(model.entries[i].name, name) == 0)
+		{
+			return &model.entries[i];
+		}
+	}
+
+	return 0;
+}
+
+static cost_entry* add_entry(char* name, uint32_t bits)
+{
+	cost_entry* e = find_entry(name, bits);
+
+	if (e != 0)
+	{
+		return e;
+	}
+
+	if (model.count == model.capacity)
+	{
+		model.capacity = model.capacity == 0 ? 32 : model.capacity * 2;
+		model.entries = (cost_entry*)realloc(model.entries, sizeof(cost_entry) * model.capacity);
+
+		if (model.entries == 0)
+		{
+			elog(LOG_FATAL_ERROR, "add_entry: out of memory\n");
+		}
+	}
+
+	e = &model.entries[model.count++];
+	memset(e, 0, sizeof(cost_entry));
+	snprintf(e->name, COST_NAME_SIZE, "%s", name);
+	e->bits = bits;
+
+	return e;
+}
+
+// Reads the cost model file, if there is one. A file from another version
+// is ignored, and replaced by the next calibration.
+static void load_model()
+{
+	char* path = model_path();
+	FILE* f;
+	char line[256];
+	char name[COST_NAME_SIZE];
+	cost_entry e;
+	cost_entry* added;
+
+	model.loaded = 1;
+
+	if (path == 0)
+	{
+		return;
+	}
+
+	f = fopen(path, "r");
+	free(path);
+
+	if (f == 0)
+	{
+		return;
+	}
+
+	if (fgets(line, sizeof(line), f) == 0 || strncmp(line, COST_MODEL_HEADER, strlen(COST_MODEL_HEADER)) != 0)
+	{
+		fclose(f);
+		return;
+	}
+
+	while (fgets(line, sizeof(line), f) != 0)
+	{
+		if (sscanf(line, "%63s %u %lf %lf %lf %lf %lf %lf %lf", name, &e.bits, &e.fixed,
+			&e.op[cost_var], &e.op[cost_bitwise], &e.op[cost_add], &e.op[cost_mul], &e.op[cost_div], &e.prepare) != 9)
+		{
+			continue;
+		}
+
+		added = add_entry(name, e.bits);
+		memcpy(added->op, e.op, sizeof(e.op));
+		added->fixed = e.fixed;
+		added->prepare = e.prepare;
+	}
+
+	fclose(f);
+}
+
+// Writes every entry to the cost model file. The file is replaced in one
+// step, so another ebe reading it never sees half of it.
+static void save_model()
+{
+	char* path = model_path();
+	char* tmp;
+	FILE* f;
+	size_t i;
+	cost_entry* e;
+
+	if (path == 0)
+	{
+		elog(LOG_VERBOSE, "cost model: no home directory, calibration not saved\n");
+		return;
+	}
+
+	tmp = (char*)malloc(strlen(path) + 32);
+
+	if (tmp == 0)
+	{
+		elog(LOG_FATAL_ERROR, "save_model: out of memory\n");
+	}
+
+	sprintf(tmp, "%s.%d", path, (int)getpid());
+
+	f = fopen(tmp, "w");
+
+	if (f == 0)
+	{
+		elog(LOG_VERBOSE, "cost model: can't write %s, calibration not saved\n", tmp);
+		free(tmp);
+		free(path);
+		return;
+	}
+
+	fprintf(f, "%s\n", COST_MODEL_HEADER);
+	fprintf(f, "# engine bits fixed var bitwise add mul div prepare, in nanoseconds\n");
+
+	for (i=0; i<model.count; i++)
+	{
+		e = &model.entries[i];
+
+		fprintf(f, "%s %u %.4f %.4f %.4f %.4f %.4f %.4f %.4f\n", e->name, e->bits, e->fixed,
+			e->op[cost_var], e->op[cost_bitwise], e->op[cost_add], e->op[cost_mul], e->op[cost_div], e->prepare);
+	}
+
+	if (fclose(f) != 0 || rename(tmp, path) != 0)
+	{
+		elog(LOG_VERBOSE, "cost model: can't write %s, calibration not saved\n", path);
+		remove(tmp);
+	}
+	else
+	{
+		elog(LOG_VERBOSE, "cost model: saved to %s\n", path);
+	}
+
+	free(tmp);
+	free(path);
+}
+
+static cost_class op_class(op_code op)
+{
+	switch (op)
+	{
+		case op_var:
+			return cost_var;
+		case op_const:
+		case op_and:
+		case op_xor:
+		case op_or:
+		case op_negate:
+			return cost_bitwise;
+		case op_add:
+		case op_sub:
+		case op_minus:
+		case op_shl:
+		case op_shr:
+			return cost_add;
+		case op_div:
+		case op_mod:
+			return cost_div;
+		default:
+			return cost_mul;
+	}
+}
+
+// Calibration program: the last two variables combined by ^, then
+// COST_CHAIN_LENGTH operators of a class, each on the two registers before
+// it. For cost_var every variable is loaded instead, and combined by ^.
+// Everything depends on the variable that changes with every assignment,
+// so the gray engine has nothing to skip.
+static program* calibration_program(cost_class c, uint32_t bits, size_t variables)
+{
+	static const op_code bitwise[] = { op_and, op_xor, op_or };
+	static const op_code add[] = { op_add, op_sub, op_shl, op_shr };
+	static const op_code mul[] = { op_mul };
+	static const op_code div[] = { op_div, op_mod };
+
+	program* p = program_init(bits);
+	const op_code* ops = 0;
+	size_t op_count = 0;
+	size_t i;
+	uint32_t r;
+
+	p->variable_count = variables;
+
+	if (c == cost_var)
+	{
+		r = program_emit(p, op_var, 0, 0);
+
+		for (i=1; i<variables; i++)
+		{
+			r = program_emit(p, op_xor, r, program_emit(p, op_var, (uint32_t)i, 0));
+		}
+
+		return p;
+	}
+
+	program_emit(p, op_var, (uint32_t)variables - 2, 0);
+	program_emit(p, op_var, (uint32_t)variables - 1, 0);
+	r = program_emit(p, op_xor, 0, 1);
+
+	switch (c)
+	{
+		case cost_bitwise: ops = bitwise; op_count = 3; break;
+		case cost_add: ops = add; op_count = 4; break;
+		case cost_mul: ops = mul; op_count = 1; break;
+		case cost_div: ops = div; op_count = 2; break;
+		default: return p;
+	}
+
+	for (i=0; i<COST_CHAIN_LENGTH; i++)
+	{
+		r = program_emit(p, ops[i % op_count], r, r - 1);
+	}
+
+	return p;
+}
+
+// Times the engine on a program. Returns nanoseconds per assignment, the
+// best of COST_SAMPLES samples, and the time to prepare the program in
+// prepare.
+static double measure(engine* eng, program* p, int32_t* values, uint8_t* nan, double* prepare)
+{
+	double start = now_ns();
+	double elapsed;
+	double best = 0;
+	uint64_t runs;
+	int sample;
+
+	if (eng->prepare != 0)
+	{
+		eng->prepare(p);
+	}
+
+	*prepare = now_ns() - start;
+
+	// once to warm up the caches
+	eng->run_range(p, 0, EVAL_CHUNK_SIZE, values, nan);
+
+	for (sample=0; sample<COST_SAMPLES; sample++)
+	{
+		start = now_ns();
+		runs = 0;
+
+		do
+		{
+			eng->run_range(p, 0, EVAL_CHUNK_SIZE, values, nan);
+			runs++;
+			elapsed = now_ns() - start;
+		}
+		while (elapsed < COST_SAMPLE_NS);
+
+		elapsed = elapsed / (double)(runs * EVAL_CHUNK_SIZE);
+
+		if (sample == 0 || elapsed < best)
+		{
+			best = elapsed;
+		}
+	}
+
+	return best;
+}
+
+// Runs the calibration programs on an engine at a width. Returns 0 if the
+// engine doesn't support the width.
+static cost_entry* calibrate(engine* eng, uint32_t bits)
+{
+	// enough variables for a whole chunk of assignments, where they fit
+	size_t variables = (12 + bits - 1) / bits;
+	double t[COST_CLASSES];
+	double base, prepare, most = 0;
+	program* p;
+	int32_t* values = (int32_t*)malloc(sizeof(int32_t) * EVAL_CHUNK_SIZE);
+	uint8_t* nan = (uint8_t*)malloc(sizeof(uint8_t) * EVAL_CHUNK_SIZE);
+	cost_entry* e;
+	int c;
+
+	if (values == 0 || nan == 0)
+	{
+		elog(LOG_FATAL_ERROR, "calibrate: out of memory\n");
+	}
+	
+	if (variables < 2)
+	{
+		variables = 2;
+	}
+
+	// every calibration program has the same features as the base program
+	p = calibration_program(cost_bitwise, bits, variables);
+
+	if (!eng->supports(p))
+	{
+		program_free(p);
+		free(values);
+		free(nan);
+		return 0;
+	}
+
+	program_free(p);
+
+	elog(LOG_VERBOSE, "cost model: calibrating engine '%s' at bits=%d\n", eng->name, bits);
+
+	// the base program is the first instructions of a chain
+	p = calibration_program(cost_bitwise, bits, variables);
+	p->length = 3;
+	base = measure(eng, p, values, nan, &prepare);
+	program_free(p);
+
+	for (c=0; c<COST_CLASSES; c++)
+	{
+		p = calibration_program((cost_class)c, bits, variables);
+		t[c] = measure(eng, p, values, nan, &prepare);
+
+		if (prepare / (double)p->length > most)
+		{
+			most = prepare / (double)p->length;
+		}
+
+		program_free(p);
+	}
+
+	e = add_entry(eng->name, bits);
+
+	for (c=0; c<COST_CLASSES; c++)
+	{
+		e->op[c] = (t[c] - base) / COST_CHAIN_LENGTH;
+	}
+
+	// the var program has variables-2 more loads and ^ than the base
+	e->op[cost_var] = variables > 2 ? (t[cost_var] - base) / (double)(variables - 2) - e->op[cost_bitwise] : 0;
+
+	for (c=0; c<COST_CLASSES; c++)
+	{
+		// noise, mostly
+		if (e->op[c] < 0)
+		{
+			e->op[c] = 0;
+		}
+	}
+
+	e->fixed = base - 2 * e->op[cost_var] - e->op[cost_bitwise];
+	e->fixed = e->fixed < 0 ? 0 : e->fixed;
+	e->prepare = most;
+
+	free(values);
+	free(nan);
+
+	return e;
+}
+
+double cost_estimate(engine* eng, program* p, uint64_t count)
+{
+	cost_entry* e = 0;
+	double per_assignment;
+	size_t i;
+	uint32_t bits = 0;
+
+	if (!model.loaded)
+	{
+		load_model();
+	}
+
+	for (i=0; i<sizeof(calibrated_bits) / sizeof(calibrated_bits[0]); i++)
+	{
+		if (calibrated_bits[i] >= p->bits)
+		{
+			bits = calibrated_bits[i];
+			break;
+		}
+	}
+
+	if (bits == 0)
+	{
+		elog(LOG_FATAL_ERROR, "cost_estimate: no calibration for bits=%d\n", p->bits);
+	}
+
+	e = find_entry(eng->name, bits);
+
+	if (e == 0)
+	{
+		e = calibrate(eng, bits);
+
+		if (e == 0)
+		{
+			elog(LOG_FATAL_ERROR, "cost_estimate: engine '%s' can't be calibrated at bits=%d\n", eng->name, bits);
+		}
+
+		save_model();
+	}
+
+	per_assignment = e->fixed;
+
+	for (i=0; i<p->length; i++)
+	{
+		per_assignment += e->op[op_class(p->code[i].op)];
+	}
+
+	return e->prepare * (double)p->length + per_assignment * (double)count;
+}
+
+void cost_model_free()
+{
+	free(model.entries);
+
+	model.entries = 0;
+	model.count = 0;
+	model.capacity = 0;
+	model.loaded = 0;
+}
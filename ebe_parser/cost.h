@@ -0,0 +1,60 @@
+#ifndef __COST_H__
+#define __COST_H__
+
+#include <stdint.h>
+
+#include "engine.h"
+#include "program.h"
+
+// Time an engine takes for a program is estimated as
+//
+//   prepare * instructions + count * (fixed + sum of op[class] per instruction)
+//
+// with the operators in classes that cost about the same in every engine.
+typedef enum cost_class
+{
+	cost_var,
+
+	// & ^ | ~ and constants
+	cost_bitwise,
+
+	// + - ` << >>
+	cost_add,
+
+	// * and the user defined operators
+	cost_mul,
+
+	// / %
+	cost_div,
+
+	COST_CLASSES
+
+} cost_class;
+
+// Widths the engines are calibrated at. A program is estimated with the
+// calibration at the smallest of these that holds its bits.
+#define COST_CALIBRATED_BITS { 1, 2, 3, 4, 8, 16, 32 }
+
+// Instructions of each class added to a calibration program
+#define COST_CHAIN_LENGTH 8
+
+// Minimum time of one sample of a calibration program, in nanoseconds, and
+// the number of samples. The fastest sample is kept, the others were
+// slowed down by something else.
+#define COST_SAMPLE_NS 100000.0
+#define COST_SAMPLES 3
+
+// Name of the file under the home directory the calibration is kept in.
+// Delete it to calibrate again, after moving to another machine.
+#define COST_MODEL_FILE ".ebe_cost_model"
+
+// Returns the estimated time, in nanoseconds, for eng to evaluate count
+// assignments of p. The engine must support p. The first estimate for an
+// engine at a width that isn't in the cost model file runs a short
+// benchmark, and adds the result to the file.
+double cost_estimate(engine* eng, program* p, uint64_t count);
+
+// Frees the cost model
+void cost_model_free();
+
+#endif
@@ -3,6 +3,10 @@
 #include <argp.h>
 
 #include "log.h"
+#include "eval.h"
+#include "optable.h"
+#include "tree.h"
+#include "cost.h"
 
 const char *argp_program_version =
 	"ebe 0.1";
@@ -29,6 +33,19 @@ static struct argp_option options[] = {
 	{"output",   'o', "FILE", 0,
 	"Output to FILE instead of standard output" },
 	{"bits",  'b', "MAX_BITS",      0,  "Max number of bits for each variable" },
+	{"bits-range",  'R', "LOW-HIGH",      0,  "Print the md5 for every number of bits LOW to HIGH. Expressions without / % >> are evaluated once, at HIGH" },
+	{"engine",  'e', "NAME",      0,  "Evaluation engine (bitslice, simd, program, ...). By default the one a cost model, calibrated once and kept in ~/" COST_MODEL_FILE ", expects to be fastest for the expression" },
+	{"check",  'c', 0,      0,  "Compare every value from the engine against the recursive evaluator" },
+	{"no-optimize",  'n', 0,      0,  "Evaluate the expression as written, without folding constants or merging repeated subexpressions" },
+	{"batch",  'B', 0,      0,  "Read expressions from standard input, one per line, instead of EXPR" },
+	{"unique",  'u', 0,      0,  "With --batch, only print the line of the first expression with the same values as each one (eval class: LINE). Expressions are compared at a few probe assignments, and evaluated in full only where those agree" },
+	{"threads",  'j', "N",      0,  "Evaluate the assignments of an expression on N threads (default 1)" },
+	{"fast",  'f', 0,      0,  "Print a 128 bit hash of the values packed to MAX_BITS bits and of their nan (eval hash) instead of the md5 of their text. Much faster, but not comparable to the md5" },
+	{"tree",  't', 0,      0,  "Also print the tree fingerprint, which can be computed in slices" },
+	{"range",  'r', "START:END",      0,  "Only evaluate assignments START to END-1, and print the tree nodes they cover" },
+	{"merge",  'M', 0,      0,  "Read slices printed with --range from standard input and print the tree fingerprint" },
+	{"cache",  'm', "MB",      0,  "Memory for the subtree truth table cache in a batch, 0 for none (default 256)" },
+	{"operator",  'p', "C=MAP",      0,  "Define the binary operator C (# $ or @) as a bitwise boolean operator id 0-15, or a comma separated output map (n for nan)" },
 	{ 0 }
 };
      
@@ -38,6 +55,19 @@ struct arguments
 	int log_level;
 	char *output_file;
 	int max_bits;
+	char* bits_range;
+	char* engine;
+	int check;
+	int optimize;
+	int batch;
+	int unique;
+	int cache_size;
+	int threads;
+	int fast;
+	int tree;
+	char* range;
+	int merge;
+	char* operators[OPTABLE_USER_OPERATORS];
 	
 	char* expression;
 };
@@ -63,6 +93,49 @@ static error_t parse_opt (int key, char *arg, struct argp_state *state)
 			break;
 		case 'b':
 			arguments->max_bits = arg ? atoi (arg) : 1;
+			if (arguments->max_bits < 1 || arguments->max_bits > 32)
+				argp_error (state, "bits must be from 1 to 32, got '%s'", arg);
+			break;
+		case 'R':
+			arguments->bits_range = arg;
+			break;
+		case 'e':
+			arguments->engine = arg;
+			break;
+		case 'c':
+			arguments->check = 1;
+			break;
+		case 'n':
+			arguments->optimize = 0;
+			break;
+		case 'B':
+			arguments->batch = 1;
+			break;
+		case 'u':
+			arguments->unique = 1;
+			break;
+		case 'j':
+			arguments->threads = atoi (arg);
+			break;
+		case 'f':
+			arguments->fast = 1;
+			break;
+		case 't':
+			arguments->tree = 1;
+			break;
+		case 'r':
+			arguments->range = arg;
+			break;
+		case 'M':
+			arguments->merge = 1;
+			break;
+		case 'm':
+			arguments->cache_size = atoi (arg);
+			break;
+		case 'p':
+			if (user_operator_index(arg[0]) < 0)
+				argp_error (state, "operator must be one of # $ @, got '%s'", arg);
+			arguments->operators[user_operator_index(arg[0])] = arg;
 			break;
 
 		case ARGP_KEY_ARG:
@@ -71,7 +144,7 @@ static error_t parse_opt (int key, char *arg, struct argp_state *state)
 
 		case ARGP_KEY_END:
 		
-			if (state->arg_num < 1)
+			if (state->arg_num < 1 && !arguments->batch && !arguments->merge)
 				// Not enough arguments.
 				argp_usage (state);
 			break;
@@ -88,11 +161,26 @@ static struct argp argp = { options, parse_opt, args_doc, doc };
 int main(int argc, char** argv)
 {
 	struct arguments arguments;
+	int i;
 
 	/* Default values. */
 	arguments.log_level = 1;
 	arguments.output_file = "-";
 	arguments.max_bits = 1;
+	arguments.bits_range = 0;
+	arguments.engine = 0;
+	arguments.check = 0;
+	arguments.optimize = 1;
+	arguments.batch = 0;
+	arguments.unique = 0;
+	arguments.cache_size = 256;
+	arguments.threads = 1;
+	arguments.fast = 0;
+	arguments.tree = 0;
+	arguments.range = 0;
+	arguments.merge = 0;
+	for (i=0; i<OPTABLE_USER_OPERATORS; i++)
+		arguments.operators[i] = 0;
 	arguments.expression = 0;
 	
 	/* Parse our arguments; every option seen by parse_opt will
@@ -102,8 +190,80 @@ int main(int argc, char** argv)
 	set_log_level(arguments.log_level);
 	set_output_file(arguments.output_file);
 	set_max_bits(arguments.max_bits);
+	set_engine(arguments.engine);
+	set_check(arguments.check);
+	set_optimize(arguments.optimize);
+	set_cache_size(arguments.cache_size);
+	set_threads(arguments.threads);
+	set_tree(arguments.tree);
+	set_fast_fingerprint(arguments.fast);
+	set_unique(arguments.unique);
+	
+	if (arguments.range != 0)
+	{
+		set_range(arguments.range);
+	}
+	
+	// a slice prints tree nodes, which are always hashed from the text
+	if (arguments.fast && (arguments.range != 0 || arguments.bits_range != 0))
+	{
+		elog(LOG_EXIT_ERROR, "--fast can't be used with --range or --bits-range\n");
+		exit(1);
+	}
+	
+	// classes are only found among the expressions of a batch, each at
+	// one width and over every assignment
+	if (arguments.unique && (!arguments.batch || arguments.range != 0 || arguments.bits_range != 0 || arguments.tree))
+	{
+		elog(LOG_EXIT_ERROR, "--unique needs --batch, and can't be used with --range, --bits-range or --tree\n");
+		exit(1);
+	}
+	
+	if (arguments.bits_range != 0)
+	{
+		// the other widths would need their own slices, fingerprints and
+		// operator tables
+		if (arguments.range != 0 || arguments.tree)
+		{
+			elog(LOG_EXIT_ERROR, "--bits-range can't be used with --range or --tree\n");
+			exit(1);
+		}
+		
+		for (i=0; i<OPTABLE_USER_OPERATORS; i++)
+		{
+			if (arguments.operators[i] != 0)
+			{
+				elog(LOG_EXIT_ERROR, "--bits-range can't be used with --operator\n");
+				exit(1);
+			}
+		}
+		
+		set_bits_range(arguments.bits_range);
+	}
+	
+	for (i=0; i<OPTABLE_USER_OPERATORS; i++)
+	{
+		if (arguments.operators[i] != 0)
+		{
+			define_user_operator(arguments.operators[i], arguments.max_bits);
+		}
+	}
+	
+	if (arguments.merge)
+	{
+		tree_merge(stdin);
+	}
+	else if (arguments.batch)
+	{
+		eval_batch(stdin);
+	}
+	else
+	{
+		eval_main(arguments.expression);
+	}
 	
-	eval_main(arguments.expression);
+	free_user_operators();
+	cost_model_free();
 
 	return 0;
 }
\ No newline at end of file
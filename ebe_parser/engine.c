@@ -0,0 +1,104 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "engine.h"
+#include "program.h"
+#include "bitslice.h"
+#include "simd.h"
+#include "jit.h"
+#include "width.h"
+#include "optable.h"
+#include "gray.h"
+#include "cost.h"
+#include "log.h"
+
+// every program is supported, p is only there to match engine.supports
+static int program_supports(program* p)
+{
+	(void)p;
+	return 1;
+}
+
+// known engines. Listed in order of preference, which breaks ties between
+// estimates, see default_engine.
+static engine engines[] =
+{
+	{ "bitslice", bitslice_supports, 0, bitslice_run_range },
+	{ "simd", simd_supports, 0, simd_run_range },
+	{ "simd-avx512", simd_avx512_supports, 0, simd_avx512_run_range },
+	{ "simd-avx2", simd_avx2_supports, 0, simd_avx2_run_range },
+	{ "simd-sse2", simd_sse2_supports, 0, simd_sse2_run_range },
+	{ "width", width_supports, 0, width_run_range },
+	{ "jit", jit_supports, jit_prepare, jit_run_range },
+	{ "table", optable_supports, optable_prepare, optable_run_range },
+	{ "gray", gray_supports, gray_prepare, gray_run_range },
+	{ "program", program_supports, 0, program_run_range },
+	{ 0, 0, 0, 0 }
+};
+
+engine* find_engine(char* name)
+{
+	engine* eng = engines;
+
+	if (name == 0)
+	{
+		return 0;
+	}
+
+	for (; eng->name != 0; eng++)
+	{
+		if (strcmp(eng->name, name) == 0)
+		{
+			return eng;
+		}
+	}
+
+	return 0;
+}
+
+engine* default_engine(program* p, uint64_t count)
+{
+	engine* eng = engines;
+	engine* best = 0;
+	double best_cost = 0;
+	double cost;
+
+	for (; eng->name != 0; eng++)
+	{
+		if (!eng->supports(p))
+		{
+			continue;
+		}
+
+		// nothing to run, any engine will do
+		if (count == 0)
+		{
+			return eng;
+		}
+
+		cost = cost_estimate(eng, p, count);
+
+		elog(LOG_VERBOSE, "engine '%s': estimated %.1f us\n", eng->name, cost / 1000);
+
+		if (best == 0 || cost < best_cost)
+		{
+			best = eng;
+			best_cost = cost;
+		}
+	}
+
+	// the program engine supports everything
+	return best != 0 ? best : find_engine("program");
+}
+
+void printf_engines()
+{
+	engine* eng = engines;
+
+	for (; eng->name != 0; eng++)
+	{
+		elog(LOG_NORMAL, "%s\n", eng->name);
+	}
+}
@@ -0,0 +1,44 @@
+#ifndef __ENGINE_H__
+#define __ENGINE_H__
+
+#include <stdint.h>
+
+#include "program.h"
+
+// An evaluation engine. Every engine produces the same values for a program,
+// they only differ in how fast they get there for a given kind of program.
+typedef struct engine
+{
+	// name used to select the engine on the command line
+	char* name;
+
+	// returns 1 if the engine can evaluate the program, otherwise 0
+	int (*supports)(program* p);
+
+	// optional, called once before the first run_range for a program
+	void (*prepare)(program* p);
+
+	// evaluates count consecutive assignments beginning at assignment index
+	// start, see program_run_range. start is always a multiple of
+	// EVAL_CHUNK_SIZE.
+	void (*run_range)(program* p, uint64_t start, uint64_t count, int32_t* values, uint8_t* nan);
+
+} engine;
+
+// number of assignments handed to an engine at a time
+#define EVAL_CHUNK_SIZE 4096
+
+// Returns the engine with the given name, or 0 if there is no such engine.
+engine* find_engine(char* name);
+
+// Returns the engine to use for count assignments of a program when none
+// is requested: the one the cost model (see cost.h) expects to be the
+// fastest. Bitwise sweeps over a few bits favour the word parallel engines,
+// arithmetic over more bits the vector or native code ones, and short
+// sweeps the ones with nothing to prepare.
+engine* default_engine(program* p, uint64_t count);
+
+// Prints the names of the known engines, LOG_NORMAL
+void printf_engines();
+
+#endif
@@ -7,6 +7,16 @@
 #include "linked_list.h"
 #include "helper.h"
 #include "log.h"
+#include "program.h"
+#include "engine.h"
+#include "optable.h"
+#include "session.h"
+#include "parallel.h"
+#include "tree.h"
+#include "lanes.h"
+#include "optimize.h"
+#include "md5x.h"
+#include "fingerprint.h"
 
 // user guide for uthash at
 // http://troydhanson.github.io/uthash/userguide.html
@@ -47,35 +57,48 @@ size_t slot_counter = 0;
 // the maximum number of bits to evaluate in a variable
 size_t max_bits = 1;
 
-uint32_t max_val = 1;
+uint64_t max_val = 2;
 uint32_t max_val_mask = 1;
 
-static void increment_variable_list_values(linked_list* list)
-{
-	linked_list_node* node = list->tail;
-	uint32_t safety = list->length;
-	
-	while(node)
-	{
-		node->var_value = node->var_value + 1;
-	
-		if (node->var_value >= max_val)
-		{
-			node->var_value = 0;
-		}
-		else
-		{
-			break;
-		}
-		
-		node = node->prev;
-		
-		if (safety-- + 1 == 0)
-		{
-			break;
-		}
-	}
-}
+// number of threads evaluating one expression
+int thread_count = 1;
+
+// name of the engine requested on the command line, 0 for the default
+char* engine_name = 0;
+
+// when set, every value from the engine is compared against eval()
+int check_engine = 0;
+
+// memory limit of the subtree cache used in batches, 0 for no cache
+size_t cache_bytes = TABLE_CACHE_DEFAULT_BYTES;
+
+// when set, the tree fingerprint is printed after the md5
+int tree_fingerprint = 0;
+
+// when set, the fast fingerprint is printed instead of the md5, see
+// fingerprint.h
+int fast_fingerprint = 0;
+
+// when set, a batch only prints which expressions have the same values,
+// see evaluate_unique
+int unique_mode = 0;
+
+// when set, only assignments range_start to range_end-1 are evaluated
+int has_range = 0;
+uint64_t range_start = 0;
+uint64_t range_end = 0;
+
+// when set, every width from bits_low to bits_high is evaluated, see
+// evaluate_widths
+int has_bits_range = 0;
+uint32_t bits_low = 0;
+uint32_t bits_high = 0;
+
+// when set, programs are optimized before they are evaluated
+int optimize_programs = 1;
+
+// what the optimizer removed from every expression evaluated
+optimize_stats optimize_totals;
 
 static void consolidate_recursive(expression_node* e)
 {
@@ -138,6 +161,7 @@ static void consolidate_recursive(expression_node* e)
 					
 					// free existing string memory
 					free(*(node->sym->value));
+					free(node->sym->value);
 					
 					// let expression.c know not to free this memory
 					node->sym->allocated = 0;
@@ -178,57 +202,87 @@ static void normalize_variables(linked_list* llist)
 	char* pval;
 	char* new_var_name;
 	struct HASH_OBJECT *s;
+	struct HASH_OBJECT **found;
 	
 	int count = 1;
+	size_t index = 0;
+	
+	found = (struct HASH_OBJECT **)malloc(sizeof(struct HASH_OBJECT *) * (llist->length + 1));
 	
+	if (found == 0)
+	{
+		elog(LOG_FATAL_ERROR, "normalize_variables: out of memory\n");
+	}
+	
+	// Take every variable out of the hash before renaming any of them. A new
+	// short name can be the old name of a variable further down the list
+	// (y,a -> a,b), which would otherwise be found and renamed a second time.
 	while(list_item)
 	{
 		ppval = list_item->var_name;
 		pval = *ppval;
+		found[index] = 0;
 		
 		if (pval != 0)
 		{	
-			//printf("found node '%s'\n", pval);
-			
-			struct HASH_OBJECT *s;
-				
 			HASH_FIND_STR(head, pval, s);
 			
 			if (s != 0)
 			{
 				// delete item from hash
 				HASH_DEL(head, s);
-				
-				// create new short name	
-				new_var_name = count_to_var_name(count);
-			
-				//printf("new name: '%s'\n", new_var_name);
-			
-				// free old memory
-				free(pval);
+				found[index] = s;
+			}
+		}
+		
+		list_item = list_item->next;
+		index++;
+	}
+	
+	list_item = llist->head;
+	index = 0;
+	
+	while(list_item)
+	{
+		s = found[index];
+		
+		if (s != 0)
+		{
+			pval = *(list_item->var_name);
 			
-				// update pointer to new memory
-				*(list_item->var_name) = new_var_name;
+			// create new short name	
+			new_var_name = count_to_var_name(count);
+		
+			// free old memory
+			free(pval);
+		
+			// update pointer to new memory
+			*(list_item->var_name) = new_var_name;
+		
+			count++;
 			
-				count++;
-				
-				// now need to update the hash with the new variable name
-				memset(s->name, 0, sizeof(char)*MAX_SYMBOL_SIZE);
-				strcpy(s->name, new_var_name);
-				HASH_ADD_STR(head, name, s );  /* name: name of key field */
-			}
+			// now need to update the hash with the new variable name
+			memset(s->name, 0, sizeof(char)*MAX_SYMBOL_SIZE);
+			strcpy(s->name, new_var_name);
+			HASH_ADD_STR(head, name, s );  /* name: name of key field */
 		}
 		
 		list_item = list_item->next;
+		index++;
 	}
+	
+	free(found);
 }
 
 int32_t eval(expression_node* e, int32_t* nan)
 {
-	int32_t final_value = 0;
+	// computed unsigned, like program_run, so 32 bit values divide and
+	// shift the same way
+	uint32_t final_value = 0;
 	
 	char* sym_value;
-	int32_t v;
+	uint32_t v;
+	uint32_t l;
 	
 	if (e == 0)
 	{
@@ -306,7 +360,7 @@ int32_t eval(expression_node* e, int32_t* nan)
 					//case '`': 
 					//case '~': 
 					case '*':
-						final_value = (eval(e->left, nan) * eval(e->right, nan)) & max_val_mask;
+						final_value = ((uint32_t)eval(e->left, nan) * (uint32_t)eval(e->right, nan)) & max_val_mask;
 						break;
 					case '/':
 						v = eval(e->right, nan);
@@ -317,7 +371,7 @@ int32_t eval(expression_node* e, int32_t* nan)
 						}
 						else
 						{
-							final_value = (eval(e->left, nan) / v) & max_val_mask;
+							final_value = ((uint32_t)eval(e->left, nan) / v) & max_val_mask;
 						}
 						break;
 					case '%':
@@ -329,29 +383,42 @@ int32_t eval(expression_node* e, int32_t* nan)
 						}
 						else
 						{
-							final_value = (eval(e->left, nan) % v) & max_val_mask;
+							final_value = ((uint32_t)eval(e->left, nan) % v) & max_val_mask;
 						}
 						break;
 					case '+':
-						final_value = (eval(e->left, nan) + eval(e->right, nan)) & max_val_mask;
+						final_value = ((uint32_t)eval(e->left, nan) + (uint32_t)eval(e->right, nan)) & max_val_mask;
 						break;
 					case '-':
-						final_value = (eval(e->left, nan) - eval(e->right, nan)) & max_val_mask;
+						final_value = ((uint32_t)eval(e->left, nan) - (uint32_t)eval(e->right, nan)) & max_val_mask;
 						break;
+					// shifting by the width of the type or more is undefined,
+					// everything has been shifted out at that point.
 					case '<':
-						final_value = (eval(e->left, nan) << eval(e->right, nan)) & max_val_mask;
+						l = eval(e->left, nan);
+						v = eval(e->right, nan);
+						final_value = v < 32 ? (l << v) & max_val_mask : 0;
 						break;
 					case '>':
-						final_value = (eval(e->left, nan) >> eval(e->right, nan)) & max_val_mask;
+						l = eval(e->left, nan);
+						v = eval(e->right, nan);
+						final_value = v < 32 ? (l >> v) & max_val_mask : 0;
 						break;
 					case '&':
-						final_value = (eval(e->left, nan) & eval(e->right, nan)) & max_val_mask;
+						final_value = ((uint32_t)eval(e->left, nan) & (uint32_t)eval(e->right, nan)) & max_val_mask;
 						break;
 					case '^':
-						final_value = (eval(e->left, nan) ^ eval(e->right, nan)) & max_val_mask;
+						final_value = ((uint32_t)eval(e->left, nan) ^ (uint32_t)eval(e->right, nan)) & max_val_mask;
 						break;
 					case '|':
-						final_value = (eval(e->left, nan) | eval(e->right, nan)) & max_val_mask;
+						final_value = ((uint32_t)eval(e->left, nan) | (uint32_t)eval(e->right, nan)) & max_val_mask;
+						break;
+					case '#':
+					case '$':
+					case '@':
+						v = eval(e->left, nan);
+						final_value = op_table_lookup(get_user_operator(user_operator_index(sym_value[0])),
+							v, (uint32_t)eval(e->right, nan), nan) & max_val_mask;
 						break;
 					default:
 						elog(LOG_FATAL_ERROR, "Attempting to evaluate unknown operator.\n");
@@ -392,17 +459,103 @@ int32_t eval(expression_node* e, int32_t* nan)
 	return final_value & max_val_mask;
 }
 
+void set_engine(char* name)
+{
+	engine_name = name;
+}
+
+void set_check(int check)
+{
+	check_engine = check;
+}
+
+void set_optimize(int optimize)
+{
+	optimize_programs = optimize;
+}
+
+void set_cache_size(size_t megabytes)
+{
+	cache_bytes = megabytes << 20;
+}
+
+void set_threads(int threads)
+{
+	if (threads < 1 || threads > PARALLEL_MAX_THREADS)
+	{
+		elog(LOG_EXIT_ERROR, "Number of threads must be between 1 and %d, got %d\n", PARALLEL_MAX_THREADS, threads);
+		exit(1);
+	}
+	
+	thread_count = threads;
+}
+
+void set_tree(int tree)
+{
+	tree_fingerprint = tree;
+}
+
+void set_fast_fingerprint(int fast)
+{
+	fast_fingerprint = fast;
+}
+
+void set_unique(int unique)
+{
+	unique_mode = unique;
+}
+
+void set_range(char* range)
+{
+	unsigned long long start, end;
+	char extra;
+	
+	if (sscanf(range, "%llu:%llu%c", &start, &end, &extra) != 2 || start >= end)
+	{
+		elog(LOG_EXIT_ERROR, "Range must be START:END with START < END, got '%s'\n", range);
+		exit(1);
+	}
+	
+	if (start % TREE_CHUNK_SIZE != 0)
+	{
+		elog(LOG_EXIT_ERROR, "Range start must be a multiple of %d, got %llu\n", TREE_CHUNK_SIZE, start);
+		exit(1);
+	}
+	
+	has_range = 1;
+	range_start = start;
+	range_end = end;
+}
+
 void set_max_bits(size_t bits)
 {
 	max_bits = bits;
-	max_val = 1 << bits;
+	max_val = 1ULL << bits;
 	
-	max_val_mask = max_val - 1;
+	max_val_mask = (uint32_t)(max_val - 1);
 	
-	elog(LOG_VERBOSE, "max_val = %d\n", max_val);
+	elog(LOG_VERBOSE, "max_val = %llu\n", (unsigned long long)max_val);
 	elog(LOG_VERBOSE, "max_val_mask = 0x%x\n", max_val_mask);
 }
 
+void set_bits_range(char* range)
+{
+	unsigned int low, high;
+	char extra;
+	
+	if (sscanf(range, "%u-%u%c", &low, &high, &extra) != 2 || low < 1 || low > high || high > 32)
+	{
+		elog(LOG_EXIT_ERROR, "Bits range must be LOW-HIGH with 1 <= LOW <= HIGH <= 32, got '%s'\n", range);
+		exit(1);
+	}
+	
+	has_bits_range = 1;
+	bits_low = low;
+	bits_high = high;
+	
+	set_max_bits(high);
+}
+
 // remove whitespace, replace tokens with eval appropriate tokens
 char* clean_expression(char* expr)
 {
@@ -460,145 +613,1311 @@ char* clean_expression(char* expr)
 	return cleaned_expr;
 }
 
-void eval_main(char* expr)
+// where evaluated chunks go, see emit_chunk
+typedef struct emit_context
 {
-	int32_t val;
-	MD5_CTX md5_ctx;
-	char md5_buffer[64];
-	char md5_length;
-	int i;
-	int32_t nan;
+	// md5 of the values, or 0 where it was worked out already or isn't
+	// printed
+	MD5_CTX* md5_ctx;
 	
-	memset(&md5_ctx, 0, sizeof(MD5_CTX));
+	// fast fingerprint of the values, or 0
+	fingerprint* fast;
 	
-	variable_names = linked_list_init();
+	// expression checked against with --check
+	expression_node* e;
 	
-	char* cleaned_expr = clean_expression(expr);
+	// name of the engine that produced the values
+	char* name;
 	
-	expression_node* e = parse(cleaned_expr);
+	// nodes of the tree fingerprint for assignments first to end-1, or 0
+	tree_stream* tree;
+	uint64_t first;
+	uint64_t end;
 	
-	felog_d(LOG_NORMAL, "raw input: %s\n", expr);
-	felog_d(LOG_NORMAL, "cleaned intput: %s\n", cleaned_expr);
+	// hash of the leaf being filled
+	MD5_CTX leaf_ctx;
+	
+	// 1 to print the values, 0 to only hash them
+	int print;
+} emit_context;
 
-	// don't need this anymore
-	free(cleaned_expr);
+// Writes the text a value is hashed as, "%d," or "n,", to buffer and
+// returns its length. buffer must hold 13 characters.
+static size_t value_text(char* buffer, int32_t val, uint8_t nan)
+{
+	char digits[10];
+	uint32_t u;
+	size_t length = 0;
+	size_t k = 0;
 	
-	// consolidate and count the number of non-constant variables
-	consolidate_recursive(e);
+	if (nan != 0)
+	{
+		buffer[0] = 'n';
+		buffer[1] = ',';
+		return 2;
+	}
 	
-	// normalize variables names to: a,b,c,d,e...
-	normalize_variables(variable_names);
+	if (val < 0)
+	{
+		buffer[length++] = '-';
+		u = 0u - (uint32_t)val;
+	}
+	else
+	{
+		u = (uint32_t)val;
+	}
+	
+	do
+	{
+		digits[k++] = (char)('0' + u % 10);
+		u /= 10;
+	}
+	while (u != 0);
 	
-	felog_d(LOG_NORMAL, "parsed intput: ");
-	printf_expression_tree(0, e);
+	while (k > 0)
+	{
+		buffer[length++] = digits[--k];
+	}
 	
-	felog_d(LOG_NORMAL, "variables: %d\n", variable_name_counter);
-	felog_d(LOG_NORMAL, "slots: %d\n", slot_counter);
-	felog_d(LOG_NORMAL, "max_bits: %d\n", max_bits);
+	buffer[length++] = ',';
 	
-	MD5_Init(&md5_ctx);
+	return length;
+}
+
+// adds one evaluated value to the md5 (and tree leaf) and prints it. The
+// md5 is left alone if it was worked out already, see hash_tables.
+static void emit_value(emit_context* ctx, int32_t val, uint8_t nan)
+{
+	char md5_buffer[16];
+	size_t md5_length;
 	
-	memset(md5_buffer, 0, sizeof(char)*64);
-	md5_length = 0;
+	if (ctx->md5_ctx == 0 && ctx->tree == 0 && !ctx->print)
+	{
+		return;
+	}
 	
-	if (variable_name_counter > 0)
+	md5_length = value_text(md5_buffer, val, nan);
+	
+	if (ctx->md5_ctx != 0)
 	{
-		printf_linked_list(variable_names);
+		MD5_Update(ctx->md5_ctx, md5_buffer, md5_length);
+	}
 	
-		uint32_t overflow = 0;
-		uint32_t max_iterations = lazy_pow(max_val, variable_name_counter, &overflow);
+	if (ctx->tree != 0)
+	{
+		MD5_Update(&ctx->leaf_ctx, md5_buffer, md5_length);
+	}
+
+	if (!ctx->print)
+	{
+		return;
+	}
+	
+	if (nan == 0)
+	{
+		felog_d(LOG_NORMAL, "%d,", val);
+	}
+	else
+	{
+		felog_d(LOG_NORMAL, "n,");
+	}
+	
+	if (is_using_file())
+	{
+		if (nan == 0)
+		{
+			elog(LOG_VERBOSE, "%d\n", val);
+		}
+		else
+		{
+			elog(LOG_VERBOSE, "n\n");
+		}
+	}
+}
+
+// Evaluates a chunk of assignments again with eval() and compares the result
+// to the values the engine produced. The value isn't compared where the
+// result is nan.
+static void check_chunk(expression_node* e, char* name, uint64_t start, uint64_t count, int32_t* values, uint8_t* nan)
+{
+	linked_list_node* list_item;
+	uint64_t j;
+	uint64_t index;
+	uint32_t shift;
+	int32_t v;
+	int32_t v_nan;
+	
+	for (j=0; j<count; j++)
+	{
+		index = start + j;
 		
-		if (overflow)
+		for (list_item = variable_names->head; list_item; list_item = list_item->next)
 		{
-			elog(LOG_EXIT_ERROR, "Too many combinations for max_bits=%d (max_val=%d), variable_name_counter=%d\n",
-				max_bits, max_val, variable_name_counter);
-			goto free_quit;
+			shift = max_bits * (uint32_t)(variable_name_counter - list_item->id);
+			list_item->var_value = shift < 64 ? (index >> shift) & max_val_mask : 0;
 		}
 		
-		elog(LOG_VERBOSE, "Evaluating all (%d) combinations\n", max_iterations);
+		v_nan = 0;
+		v = eval(e, &v_nan);
 		
-		size_t iter_count = 0;
-		for(; iter_count < max_iterations; iter_count++)
+		if ((v_nan != 0) != (nan[j] != 0) || (v_nan == 0 && v != values[j]))
 		{
-			elog(LOG_VERBOSE, "\n");
-			printf_linked_list(variable_names);
-			
-			nan = 0;
-			val = eval(e, &nan);
-			
-			memset(md5_buffer, 0, sizeof(char)*64);
-			md5_length = 0;
-			
-			if (nan == 0)
-			{
-				sprintf(md5_buffer, "%d,", val);
-			}
-			else
-			{
-				sprintf(md5_buffer, "n,");
-			}
-			
-			md5_length = strlen(md5_buffer);
-			
-			MD5_Update(&md5_ctx, md5_buffer, md5_length);
-
-			if (nan == 0)
-			{
-				felog_d(LOG_NORMAL, "%d,", val);
-			}
-			else
-			{
-				felog_d(LOG_NORMAL, "n,");
-			}
-			
-			if (is_using_file())
-			{
-				if (nan == 0)
-				{
-					elog(LOG_VERBOSE, "%d\n", val);
-				}
-				else
-				{
-					elog(LOG_VERBOSE, "n\n");
-				}
-			}
-
-			increment_variable_list_values(variable_names);
+			elog(LOG_FATAL_ERROR, "Engine '%s' disagrees with eval at assignment %llu: %d%s, expected %d%s\n",
+				name, (unsigned long long)index,
+				values[j], nan[j] ? " (nan)" : "", v, v_nan ? " (nan)" : "");
 		}
-		felog_d(LOG_NORMAL, "\n");
 	}
-	else
+}
+
+// Checks a chunk of values, if asked to, then adds them to the md5 and
+// prints them. Chunks must come in order of the assignments.
+static void emit_chunk(void* context, uint64_t start, uint64_t count, int32_t* values, uint8_t* nan)
+{
+	emit_context* ctx = (emit_context*)context;
+	tree_digest leaf;
+	uint64_t index;
+	uint64_t j;
+	
+	if (check_engine)
 	{
-		nan = 0;
-		val = eval(e, &nan);
+		check_chunk(ctx->e, ctx->name, start, count, values, nan);
+	}
+	
+	if (ctx->fast != 0)
+	{
+		fingerprint_add(ctx->fast, values, nan, count);
+	}
+	
+	for (j=0; j<count; j++)
+	{
+		index = start + j;
 		
-		if (nan == 0)
+		if (ctx->tree != 0 && index % TREE_CHUNK_SIZE == 0)
 		{
-			felog_d(LOG_NORMAL, "%d,\n", val);
+			MD5_Init(&ctx->leaf_ctx);
 		}
-		else
+		
+		emit_value(ctx, values[j], nan[j]);
+		
+		if (ctx->tree != 0 && ((index + 1) % TREE_CHUNK_SIZE == 0 || index + 1 == ctx->end))
 		{
-			felog_d(LOG_NORMAL, "n,\n");
+			MD5_Final(leaf.bytes, &ctx->leaf_ctx);
+			tree_stream_add(ctx->tree, &leaf);
 		}
 	}
+}
+
+// Forgets the variables of the previous expression
+static void reset_variables()
+{
+	struct HASH_OBJECT *s;
+	struct HASH_OBJECT *tmp;
 	
-	memset(md5_buffer, 0, sizeof(char)*64);
-	MD5_Final(md5_buffer, &md5_ctx);
+	HASH_ITER(hh, head, s, tmp)
+	{
+		HASH_DEL(head, s);
+		free(s);
+	}
 	
+	variable_name_counter = 0;
+	slot_counter = 0;
+}
 
-	felog_d(LOG_NORMAL, "eval md5: ");
+// Returns the number of assignments the engine runs on, 0 for an
+// expression without variables
+static uint64_t assignment_count()
+{
+	uint32_t overflow = 0;
+	uint64_t count;
 	
-	while(i<16)
+	if (variable_name_counter == 0)
 	{
-		felog_d(LOG_NORMAL, "%.02x", (unsigned char)(md5_buffer[i]));
-		i++;
+		return 0;
 	}
 	
-	felog_d(LOG_NORMAL, "\n");
-
+	if (has_range)
+	{
+		return range_end - range_start;
+	}
 	
-free_quit:
+	count = lazy_pow(max_val, variable_name_counter, &overflow);
+	
+	// the overflow is reported before anything is evaluated
+	return overflow ? UINT64_MAX : count;
+}
 
-	free_expression_node(e);
-	linked_list_free(variable_names);
+// Returns the engine requested on the command line, or the engine the cost
+// model picks for count assignments of the program, ready to run.
+static engine* choose_engine(program* prog, uint64_t count)
+{
+	engine* eng;
+	
+	if (engine_name != 0)
+	{
+		eng = find_engine(engine_name);
+		
+		if (eng == 0)
+		{
+			elog(LOG_EXIT_ERROR, "Unknown engine '%s'. Known engines are:\n", engine_name);
+			printf_engines();
+			exit(1);
+		}
+		
+		if (!eng->supports(prog))
+		{
+			elog(LOG_EXIT_ERROR, "Engine '%s' can't evaluate this expression with max_bits=%d\n",
+				engine_name, max_bits);
+			exit(1);
+		}
+	}
+	else
+	{
+		eng = default_engine(prog, count);
+	}
+	
+	elog(LOG_VERBOSE, "Using engine '%s'\n", eng->name);
+	
+	if (eng->prepare != 0)
+	{
+		eng->prepare(prog);
+	}
+	
+	return eng;
+}
+
+// Parses an expression and lowers it to a program, optimized unless
+// set_optimize turned that off. The variables of the
+// expression are left in variable_names, to be freed by the caller along
+// with the tree. When print is 1 every step is printed.
+static program* compile_expression(char* expr, expression_node** tree, int print)
+{
+	program* prog;
+	optimize_stats stats;
+	
+	reset_variables();
+	
+	variable_names = linked_list_init();
+	
+	char* cleaned_expr = clean_expression(expr);
+	
+	expression_node* e = parse(cleaned_expr);
+	
+	if (print)
+	{
+		felog_d(LOG_NORMAL, "raw input: %s\n", expr);
+		felog_d(LOG_NORMAL, "cleaned intput: %s\n", cleaned_expr);
+	}
+
+	// don't need this anymore
+	free(cleaned_expr);
+	
+	// consolidate and count the number of non-constant variables
+	consolidate_recursive(e);
+	
+	// normalize variables names to: a,b,c,d,e...
+	normalize_variables(variable_names);
+	
+	if (print)
+	{
+		felog_d(LOG_NORMAL, "parsed intput: ");
+		printf_expression_tree(0, e);
+		
+		felog_d(LOG_NORMAL, "variables: %d\n", variable_name_counter);
+		felog_d(LOG_NORMAL, "slots: %d\n", slot_counter);
+		felog_d(LOG_NORMAL, "max_bits: %d\n", max_bits);
+	}
+	
+	// lower the tree once, the enumeration below only runs the program
+	prog = program_compile(e, variable_names, max_bits);
+	
+	if (optimize_programs)
+	{
+		memset(&stats, 0, sizeof(optimize_stats));
+		program_optimize(prog, &stats);
+		
+		// expressions read ahead in a batch are compiled again when they
+		// are printed, and only counted then
+		if (print)
+		{
+			felog_d(LOG_VERBOSE, "optimized: %d of %d instructions removed\n",
+				(int)(stats.before - stats.after), (int)stats.before);
+			
+			optimize_totals.programs += stats.programs;
+			optimize_totals.before += stats.before;
+			optimize_totals.after += stats.after;
+			optimize_totals.folded += stats.folded;
+			optimize_totals.simplified += stats.simplified;
+			optimize_totals.merged += stats.merged;
+		}
+	}
+	
+	if (print)
+	{
+		printf_program(prog);
+	}
+	
+	*tree = e;
+	
+	return prog;
+}
+
+// Parses, evaluates and prints one expression. With a session the truth
+// tables are kept for the next expression, see session.h. With a table the
+// values were already computed (see lanes.h) and are only printed, and with
+// a digest so was their md5 (see hash_tables).
+static void evaluate(char* expr, eval_session* session, truth_table* table, unsigned char* digest)
+{
+	int32_t val;
+	MD5_CTX md5_ctx;
+	char md5_buffer[64];
+	fingerprint fast;
+	int i = 0;
+	int32_t nan;
+	
+	program* prog;
+	engine* eng = 0;
+	int32_t* regs;
+	emit_context emit;
+	int32_t* table_values;
+	uint8_t* table_nan;
+	int use_session;
+	int prog_owned = 1;
+	expression_node* e;
+	
+	memset(&md5_ctx, 0, sizeof(MD5_CTX));
+	emit.tree = 0;
+	emit.fast = 0;
+	emit.print = 1;
+	
+	prog = compile_expression(expr, &e, 1);
+	
+	// an engine asked for on the command line wins over the session, and
+	// the session always evaluates every assignment
+	use_session = table == 0 && session != 0 && engine_name == 0 && variable_name_counter > 0 &&
+		!has_range && session_supports(prog);
+	
+	if (!use_session && table == 0)
+	{
+		eng = choose_engine(prog, assignment_count());
+	}
+	
+	regs = (int32_t*)malloc(sizeof(int32_t) * prog->length);
+	
+	if (regs == 0)
+	{
+		elog(LOG_FATAL_ERROR, "eval_main: out of memory\n");
+	}
+	
+	MD5_Init(&md5_ctx);
+	
+	if (fast_fingerprint)
+	{
+		fingerprint_init(&fast, (uint32_t)max_bits);
+	}
+	
+	if (variable_name_counter > 0)
+	{
+		printf_linked_list(variable_names);
+	
+		uint32_t overflow = 0;
+		uint64_t max_iterations = lazy_pow(max_val, variable_name_counter, &overflow);
+		
+		if (overflow)
+		{
+			elog(LOG_EXIT_ERROR, "Too many combinations for max_bits=%d (max_val=%llu), variable_name_counter=%d\n",
+				(int)max_bits, (unsigned long long)max_val, (int)variable_name_counter);
+			goto free_quit;
+		}
+		
+		elog(LOG_VERBOSE, "Evaluating all (%llu) combinations\n", (unsigned long long)max_iterations);
+		
+		emit.md5_ctx = digest != 0 || fast_fingerprint ? 0 : &md5_ctx;
+		emit.fast = fast_fingerprint ? &fast : 0;
+		emit.e = e;
+		emit.first = has_range ? range_start : 0;
+		emit.end = has_range ? range_end : max_iterations;
+		
+		if (emit.end > max_iterations)
+		{
+			elog(LOG_EXIT_ERROR, "Range end %llu is past the last assignment (%llu combinations)\n",
+				(unsigned long long)emit.end, (unsigned long long)max_iterations);
+			exit(1);
+		}
+		
+		// a slice can't end inside a leaf, unless it is the last one
+		if (emit.end % TREE_CHUNK_SIZE != 0 && emit.end != max_iterations)
+		{
+			elog(LOG_EXIT_ERROR, "Range end must be a multiple of %d or the number of combinations (%llu), got %llu\n",
+				TREE_CHUNK_SIZE, (unsigned long long)max_iterations, (unsigned long long)emit.end);
+			exit(1);
+		}
+		
+		if (tree_fingerprint || has_range)
+		{
+			emit.tree = (tree_stream*)malloc(sizeof(tree_stream));
+			
+			if (emit.tree == 0)
+			{
+				elog(LOG_FATAL_ERROR, "eval_main: out of memory 2\n");
+			}
+			
+			tree_stream_init(emit.tree, emit.first, emit.end, max_iterations);
+		}
+		
+		if (table != 0)
+		{
+			emit.name = "lanes";
+			emit_chunk(&emit, 0, max_iterations, table->values, table->nan);
+		}
+		else if (use_session)
+		{
+			session_run(session, prog, &table_values, &table_nan);
+			prog_owned = 0;
+			
+			emit.name = "session";
+			emit_chunk(&emit, 0, max_iterations, table_values, table_nan);
+		}
+		else
+		{
+			// eval() and the variable list are only used by emit_chunk on
+			// this thread, the workers only read the program
+			emit.name = eng->name;
+			parallel_run(eng, prog, emit.first, emit.end, thread_count, emit_chunk, &emit);
+		}
+		felog_d(LOG_NORMAL, "\n");
+	}
+	else
+	{
+		if (has_range)
+		{
+			elog(LOG_EXIT_ERROR, "A range needs an expression with variables\n");
+			exit(1);
+		}
+		
+		nan = 0;
+		val = program_run(prog, 0, regs, &nan);
+		
+		if (nan == 0)
+		{
+			felog_d(LOG_NORMAL, "%d,\n", val);
+		}
+		else
+		{
+			felog_d(LOG_NORMAL, "n,\n");
+		}
+	}
+	
+	memset(md5_buffer, 0, sizeof(char)*64);
+	MD5_Final(md5_buffer, &md5_ctx);
+	
+	if (digest != 0)
+	{
+		memcpy(md5_buffer, digest, 16);
+	}
+	
+	// the md5 of a slice is of no use, the nodes are merged instead
+	if (has_range)
+	{
+		printf_tree_range(emit.tree);
+		goto free_quit;
+	}
+
+	if (fast_fingerprint)
+	{
+		fingerprint_final(&fast, (unsigned char*)md5_buffer);
+		felog_d(LOG_NORMAL, "eval hash: ");
+	}
+	else
+	{
+		felog_d(LOG_NORMAL, "eval md5: ");
+	}
+	
+	while(i<16)
+	{
+		felog_d(LOG_NORMAL, "%.02x", (unsigned char)(md5_buffer[i]));
+		i++;
+	}
+	
+	felog_d(LOG_NORMAL, "\n");
+	
+	if (emit.tree != 0)
+	{
+		printf_tree_root(emit.tree);
+	}
+
+	
+free_quit:
+
+	free(emit.tree);
+	free(regs);
+	if (prog_owned)
+	{
+		program_free(prog);
+	}
+	free_expression_node(e);
+	linked_list_free(variable_names);
+}
+
+// Prints the md5 of one width of evaluate_widths
+static void print_width_md5(uint32_t bits, MD5_CTX* md5_ctx)
+{
+	unsigned char md5_buffer[16];
+	int i;
+	
+	MD5_Final(md5_buffer, md5_ctx);
+	
+	felog_d(LOG_NORMAL, "bits: %d\n", (int)bits);
+	felog_d(LOG_NORMAL, "eval md5: ");
+	
+	for (i=0; i<16; i++)
+	{
+		felog_d(LOG_NORMAL, "%.02x", md5_buffer[i]);
+	}
+	
+	felog_d(LOG_NORMAL, "\n");
+}
+
+// Returns 1 if the low k bits of every register only depend on the low k
+// bits of the variables, for every width k of the bits range, otherwise 0.
+// + - * & | ^ ~ and unary minus are like that. << only is for a constant
+// amount the same at every width, below 2^bits_low: a larger one is masked
+// to a different amount at the lower widths, and a shift by the width or
+// more gives 0. / % and >> never are, and user operators are tables.
+static int is_projectable(program* p)
+{
+	instruction* in;
+	size_t i;
+	
+	for (i=0; i<p->length; i++)
+	{
+		in = &p->code[i];
+		
+		switch (in->op)
+		{
+			case op_const:
+			case op_var:
+			case op_mul:
+			case op_add:
+			case op_sub:
+			case op_and:
+			case op_xor:
+			case op_or:
+			case op_minus:
+			case op_negate:
+				break;
+			case op_shl:
+				if (p->code[in->b].op != op_const || p->code[in->b].a >= (1U << bits_low))
+				{
+					return 0;
+				}
+				break;
+			default:
+				return 0;
+		}
+	}
+	
+	return 1;
+}
+
+// where the values of the highest width go, see project_chunk
+typedef struct project_context
+{
+	// the md5 of every width, by bits
+	emit_context widths[33];
+	
+	// the bits of the assignment index holding bit b of every variable
+	uint64_t columns[32];
+	
+	expression_node* e;
+	char* name;
+} project_context;
+
+// Adds the values of a chunk of bits_high assignments to every width whose
+// assignments they are. An assignment of a lower width k has every variable
+// below 2^k, and the bits_high assignments like that come in the same order
+// as the ones of width k, so each width gets its values in order.
+static void project_chunk(void* context, uint64_t start, uint64_t count, int32_t* values, uint8_t* nan)
+{
+	project_context* ctx = (project_context*)context;
+	uint64_t index;
+	uint64_t j;
+	uint32_t width;
+	uint32_t k;
+	
+	if (check_engine)
+	{
+		check_chunk(ctx->e, ctx->name, start, count, values, nan);
+	}
+	
+	for (j=0; j<count; j++)
+	{
+		index = start + j;
+		
+		// the narrowest width holding every variable
+		for (width = bits_high; width > bits_low && (index & ctx->columns[width - 1]) == 0; width--)
+		{
+		}
+		
+		for (k=width; k<=bits_high; k++)
+		{
+			emit_value(&ctx->widths[k], (int32_t)((uint32_t)values[j] & (uint32_t)((1ULL << k) - 1)), 0);
+		}
+	}
+}
+
+// Evaluates an expression at every width of the bits range, and prints the
+// md5 of each. If the expression only has operators the low bits of whose
+// result depend only on the low bits of the operands (T-functions, see
+// is_projectable), it is evaluated once at the highest width and the
+// values of the lower widths are masked from that. Otherwise each width is
+// evaluated on its own.
+static void evaluate_widths(char* expr)
+{
+	MD5_CTX md5_ctx;
+	project_context* project;
+	emit_context emit;
+	expression_node* e;
+	program* prog;
+	program* raw;
+	engine* eng;
+	uint32_t overflow = 0;
+	uint64_t count;
+	uint32_t bits;
+	uint32_t k;
+	int projectable;
+	
+	set_max_bits(bits_high);
+	prog = compile_expression(expr, &e, 1);
+	
+	// the optimizer applies identities that hold at one width only, so
+	// the operators are checked as written
+	raw = program_compile(e, variable_names, bits_high);
+	projectable = variable_name_counter > 0 && is_projectable(raw);
+	program_free(raw);
+	
+	if (projectable)
+	{
+		elog(LOG_VERBOSE, "bits %d to %d projected from one evaluation\n", bits_low, bits_high);
+		
+		count = lazy_pow(max_val, variable_name_counter, &overflow);
+		
+		if (overflow)
+		{
+			elog(LOG_EXIT_ERROR, "Too many combinations for max_bits=%d (max_val=%llu), variable_name_counter=%d\n",
+				(int)max_bits, (unsigned long long)max_val, (int)variable_name_counter);
+			exit(1);
+		}
+		
+		project = (project_context*)malloc(sizeof(project_context));
+		
+		if (project == 0)
+		{
+			elog(LOG_FATAL_ERROR, "evaluate_widths: out of memory\n");
+		}
+		
+		memset(project, 0, sizeof(project_context));
+		
+		for (k=bits_low; k<=bits_high; k++)
+		{
+			project->widths[k].md5_ctx = (MD5_CTX*)malloc(sizeof(MD5_CTX));
+			
+			if (project->widths[k].md5_ctx == 0)
+			{
+				elog(LOG_FATAL_ERROR, "evaluate_widths: out of memory 2\n");
+			}
+			
+			MD5_Init(project->widths[k].md5_ctx);
+		}
+		
+		for (bits=0; bits<bits_high; bits++)
+		{
+			for (k=0; k<variable_name_counter; k++)
+			{
+				project->columns[bits] |= 1ULL << (bits_high * k + bits);
+			}
+		}
+		
+		eng = choose_engine(prog, count);
+		project->e = e;
+		project->name = eng->name;
+		
+		parallel_run(eng, prog, 0, count, thread_count, project_chunk, project);
+		
+		for (k=bits_low; k<=bits_high; k++)
+		{
+			print_width_md5(k, project->widths[k].md5_ctx);
+			free(project->widths[k].md5_ctx);
+		}
+		
+		free(project);
+		program_free(prog);
+		free_expression_node(e);
+		linked_list_free(variable_names);
+		return;
+	}
+	
+	program_free(prog);
+	free_expression_node(e);
+	linked_list_free(variable_names);
+	
+	elog(LOG_VERBOSE, "bits %d to %d evaluated one at a time\n", bits_low, bits_high);
+	
+	for (bits=bits_low; bits<=bits_high; bits++)
+	{
+		set_max_bits(bits);
+		prog = compile_expression(expr, &e, 0);
+		
+		memset(&emit, 0, sizeof(emit_context));
+		emit.md5_ctx = &md5_ctx;
+		emit.e = e;
+		
+		MD5_Init(&md5_ctx);
+		
+		if (variable_name_counter > 0)
+		{
+			count = lazy_pow(max_val, variable_name_counter, &overflow);
+			
+			if (overflow)
+			{
+				elog(LOG_EXIT_ERROR, "Too many combinations for max_bits=%d (max_val=%llu), variable_name_counter=%d\n",
+					(int)max_bits, (unsigned long long)max_val, (int)variable_name_counter);
+				exit(1);
+			}
+			
+			eng = choose_engine(prog, count);
+			emit.name = eng->name;
+			parallel_run(eng, prog, 0, count, thread_count, emit_chunk, &emit);
+		}
+		
+		// like evaluate, the md5 of an expression without variables is of
+		// no values
+		print_width_md5(bits, &md5_ctx);
+		
+		program_free(prog);
+		free_expression_node(e);
+		linked_list_free(variable_names);
+	}
+	
+	set_max_bits(bits_high);
+}
+
+void eval_main(char* expr)
+{
+	if (has_bits_range)
+	{
+		evaluate_widths(expr);
+		return;
+	}
+	
+	evaluate(expr, 0, 0, 0);
+}
+
+// Expressions with the same probe signature, see evaluate_unique
+typedef struct unique_class
+{
+	// hash of the values at the probe assignments
+	tree_digest signature;
+	
+	// 1 if the probes were every assignment, so the signature tells the
+	// values apart on its own
+	int exact;
+	
+	// line of the first expression of each class with the signature, its
+	// text, and the fast fingerprint of all of its values once it was
+	// needed
+	uint64_t* lines;
+	char** exprs;
+	tree_digest* fingerprints;
+	uint8_t* has_fingerprint;
+	size_t count;
+	
+	UT_hash_handle hh;
+	
+} unique_class;
+
+typedef struct unique_state
+{
+	unique_class* classes;
+	
+	// expressions read so far
+	uint64_t lines;
+	
+	// expressions whose values were all evaluated, and how many of them
+	// turned out new
+	uint64_t evaluated;
+	uint64_t classes_count;
+	
+} unique_state;
+
+// Number of pseudo-random probe assignments, besides all zeros, all ones
+// and every single bit set
+#define UNIQUE_RANDOM_PROBES 16
+
+// the fingerprint covers every assignment from 0 in order, so each chunk
+// has to start where the previous one ended
+static void add_fingerprint_chunk(void* context, uint64_t start, uint64_t count, int32_t* values, uint8_t* nan)
+{
+	fingerprint* fp = (fingerprint*)context;
+	
+	if (start != fp->count)
+	{
+		elog(LOG_FATAL_ERROR, "add_fingerprint_chunk: chunk at %llu, expected %llu\n",
+			(unsigned long long)start, (unsigned long long)fp->count);
+	}
+	
+	fingerprint_add(fp, values, nan, count);
+}
+
+// Evaluates every assignment of a compiled program into the fast
+// fingerprint
+static void full_fingerprint(program* prog, tree_digest* result)
+{
+	fingerprint fp;
+	engine* eng;
+	uint64_t count = assignment_count();
+	
+	if (count == UINT64_MAX)
+	{
+		elog(LOG_EXIT_ERROR, "Too many combinations for max_bits=%d (max_val=%llu), variable_name_counter=%d\n",
+			(int)max_bits, (unsigned long long)max_val, (int)variable_name_counter);
+		exit(1);
+	}
+	
+	fingerprint_init(&fp, (uint32_t)max_bits);
+	
+	if (count > 0)
+	{
+		eng = choose_engine(prog, count);
+		parallel_run(eng, prog, 0, count, thread_count, add_fingerprint_chunk, &fp);
+	}
+	
+	fingerprint_final(&fp, result->bytes);
+}
+
+// Hashes the values of a compiled program at the probe assignments: all
+// zeros, all ones, each variable with a single bit set and the others 0,
+// and UNIQUE_RANDOM_PROBES pseudo-random ones, the same for every
+// expression. Where that is as many as there are assignments, every
+// assignment is probed instead and *exact is set to 1.
+static void probe_signature(program* prog, tree_digest* signature, int* exact)
+{
+	fingerprint fp;
+	size_t n = variable_name_counter;
+	size_t probes = 2 + n * max_bits + UNIQUE_RANDOM_PROBES;
+	uint64_t count = assignment_count();
+	uint64_t state = 0x9e3779b97f4a7c15ULL;
+	uint64_t z;
+	int32_t* vars;
+	int32_t* regs;
+	int32_t value;
+	int32_t nan;
+	uint8_t is_nan;
+	size_t p, k;
+	
+	vars = (int32_t*)malloc(sizeof(int32_t) * (n + 1));
+	regs = (int32_t*)malloc(sizeof(int32_t) * prog->length);
+	
+	if (vars == 0 || regs == 0)
+	{
+		elog(LOG_FATAL_ERROR, "probe_signature: out of memory\n");
+	}
+	
+	*exact = count <= probes;
+	
+	// without variables the one value is probed
+	if (*exact)
+	{
+		probes = n == 0 ? 1 : (size_t)count;
+	}
+	
+	fingerprint_init(&fp, (uint32_t)max_bits);
+	
+	for (p=0; p<probes; p++)
+	{
+		for (k=0; k<n; k++)
+		{
+			if (*exact)
+			{
+				// the digits of assignment p, the last variable lowest
+				vars[k] = (int32_t)((p >> (max_bits * (n - 1 - k))) & max_val_mask);
+			}
+			else if (p < 2)
+			{
+				vars[k] = p == 0 ? 0 : (int32_t)max_val_mask;
+			}
+			else if (p < 2 + n * max_bits)
+			{
+				vars[k] = (p - 2) / max_bits == k ? (int32_t)(1u << ((p - 2) % max_bits)) : 0;
+			}
+			else
+			{
+				// splitmix64
+				z = (state += 0x9e3779b97f4a7c15ULL);
+				z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+				z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+				vars[k] = (int32_t)((z ^ (z >> 31)) & max_val_mask);
+			}
+		}
+		
+		nan = 0;
+		value = program_run(prog, vars, regs, &nan);
+		is_nan = nan != 0;
+		
+		fingerprint_add(&fp, &value, &is_nan, 1);
+	}
+	
+	fingerprint_final(&fp, signature->bytes);
+	
+	free(regs);
+	free(vars);
+}
+
+// Returns the fast fingerprint of class k of a signature, evaluating its
+// first expression the first time
+static tree_digest* class_fingerprint(unique_class* c, size_t k, unique_state* state)
+{
+	expression_node* e;
+	program* prog;
+	
+	if (!c->has_fingerprint[k])
+	{
+		prog = compile_expression(c->exprs[k], &e, 0);
+		full_fingerprint(prog, &c->fingerprints[k]);
+		c->has_fingerprint[k] = 1;
+		state->evaluated++;
+		
+		program_free(prog);
+		free_expression_node(e);
+		linked_list_free(variable_names);
+	}
+	
+	return &c->fingerprints[k];
+}
+
+// Prints "eval class: LINE", the line of the first expression of the batch
+// with the same values as expr. The values are first compared at a few
+// probe assignments. An expression whose signature wasn't seen before is
+// new without evaluating anything else. Only where the signatures match
+// are all the values evaluated, into the fast fingerprint, for this
+// expression and the earlier ones with the signature.
+static void evaluate_unique(char* expr, unique_state* state)
+{
+	unique_class* c;
+	tree_digest signature;
+	tree_digest full;
+	expression_node* e;
+	program* prog;
+	int exact;
+	size_t k;
+	uint64_t line = ++state->lines;
+	uint64_t first = line;
+	
+	prog = compile_expression(expr, &e, 0);
+	probe_signature(prog, &signature, &exact);
+	
+	HASH_FIND(hh, state->classes, &signature, sizeof(tree_digest), c);
+	
+	if (c != 0 && !c->exact)
+	{
+		full_fingerprint(prog, &full);
+		state->evaluated++;
+	}
+	
+	// the classes compile their own expressions
+	program_free(prog);
+	free_expression_node(e);
+	linked_list_free(variable_names);
+	
+	if (c != 0 && c->exact)
+	{
+		first = c->lines[0];
+	}
+	else if (c != 0)
+	{
+		for (k=0; k<c->count; k++)
+		{
+			if (memcmp(class_fingerprint(c, k, state)->bytes, full.bytes, sizeof(tree_digest)) == 0)
+			{
+				first = c->lines[k];
+				break;
+			}
+		}
+	}
+	
+	if (first == line)
+	{
+		if (c == 0)
+		{
+			c = (unique_class*)malloc(sizeof(unique_class));
+			
+			if (c == 0)
+			{
+				elog(LOG_FATAL_ERROR, "evaluate_unique: out of memory\n");
+			}
+			
+			memset(c, 0, sizeof(unique_class));
+			c->signature = signature;
+			c->exact = exact;
+			
+			HASH_ADD(hh, state->classes, signature, sizeof(tree_digest), c);
+		}
+		
+		k = c->count++;
+		
+		c->lines = (uint64_t*)realloc(c->lines, sizeof(uint64_t) * c->count);
+		c->exprs = (char**)realloc(c->exprs, sizeof(char*) * c->count);
+		c->fingerprints = (tree_digest*)realloc(c->fingerprints, sizeof(tree_digest) * c->count);
+		c->has_fingerprint = (uint8_t*)realloc(c->has_fingerprint, sizeof(uint8_t) * c->count);
+		
+		if (c->lines == 0 || c->exprs == 0 || c->fingerprints == 0 || c->has_fingerprint == 0)
+		{
+			elog(LOG_FATAL_ERROR, "evaluate_unique: out of memory 2\n");
+		}
+		
+		c->lines[k] = line;
+		c->exprs[k] = strdup(expr);
+		c->has_fingerprint[k] = 0;
+		
+		// a class found new after a full evaluation keeps it
+		if (k > 0)
+		{
+			c->fingerprints[k] = full;
+			c->has_fingerprint[k] = 1;
+		}
+		
+		state->classes_count++;
+	}
+	
+	felog_d(LOG_NORMAL, "eval class: %llu\n", (unsigned long long)first);
+}
+
+static void free_unique(unique_state* state)
+{
+	unique_class* c;
+	unique_class* tmp;
+	size_t k;
+	
+	elog(LOG_VERBOSE, "unique: %llu expressions, %llu classes, %llu evaluated in full\n",
+		(unsigned long long)state->lines, (unsigned long long)state->classes_count,
+		(unsigned long long)state->evaluated);
+	
+	HASH_ITER(hh, state->classes, c, tmp)
+	{
+		HASH_DEL(state->classes, c);
+		
+		for (k=0; k<c->count; k++)
+		{
+			free(c->exprs[k]);
+		}
+		
+		free(c->lines);
+		free(c->exprs);
+		free(c->fingerprints);
+		free(c->has_fingerprint);
+		free(c);
+	}
+}
+
+// expressions of the same shape read ahead by eval_batch
+typedef struct lane_group
+{
+	char* lines[LANES_MAX];
+	program* programs[LANES_MAX];
+	size_t count;
+
+	// number of groups and expressions evaluated in lanes
+	uint64_t groups;
+	uint64_t expressions;
+} lane_group;
+
+// Values of each table hash_tables adds in a turn. The text of a value is
+// at most 12 characters, so a turn is less than the buffer of a lane of md5x
+// and the buffers of all the lanes fill together.
+#define HASH_TURN 64
+
+// Works out the md5 of the values of every table at once, a message per
+// lane of md5x, the way emit_value adds them to the md5 of one expression.
+static void hash_tables(truth_table** tables, size_t count, uint64_t size, unsigned char digests[][16])
+{
+	md5x_ctx* ctx;
+	char* text;
+	size_t length;
+	uint64_t start;
+	uint64_t end;
+	uint64_t j;
+	size_t k;
+	
+	ctx = (md5x_ctx*)malloc(sizeof(md5x_ctx));
+	text = (char*)malloc(sizeof(char) * 16 * HASH_TURN);
+	
+	if (ctx == 0 || text == 0)
+	{
+		elog(LOG_FATAL_ERROR, "hash_tables: out of memory\n");
+	}
+	
+	md5x_init(ctx, count);
+	
+	for (start=0; start<size; start+=HASH_TURN)
+	{
+		end = start + HASH_TURN < size ? start + HASH_TURN : size;
+		
+		for (k=0; k<count; k++)
+		{
+			length = 0;
+			
+			for (j=start; j<end; j++)
+			{
+				length += value_text(text + length, tables[k]->values[j], tables[k]->nan[j]);
+			}
+			
+			md5x_update(ctx, k, text, length);
+		}
+	}
+	
+	md5x_final(ctx, digests);
+	
+	free(text);
+	free(ctx);
+}
+
+// Evaluates and prints the expressions of a group, in lanes if there are
+// enough of them, and empties the group.
+static void flush_group(lane_group* group, eval_session* session)
+{
+	truth_table* tables[LANES_MAX];
+	unsigned char digests[LANES_MAX][16];
+	int use_lanes = group->count >= LANES_MIN;
+	program* p;
+	size_t k;
+	
+	if (use_lanes)
+	{
+		p = group->programs[0];
+		
+		lanes_run(group->programs, group->count, tables);
+		
+		if (!fast_fingerprint)
+		{
+			hash_tables(tables, group->count, (uint64_t)1 << (p->bits * p->variable_count), digests);
+		}
+		
+		group->groups++;
+		group->expressions += group->count;
+	}
+	
+	for (k=0; k<group->count; k++)
+	{
+		evaluate(group->lines[k], session, use_lanes ? tables[k] : 0, use_lanes && !fast_fingerprint ? digests[k] : 0);
+		
+		if (use_lanes)
+		{
+			truth_table_release(tables[k]);
+		}
+		
+		free(group->lines[k]);
+		program_free(group->programs[k]);
+	}
+	
+	group->count = 0;
+}
+
+void eval_batch(FILE* f)
+{
+	eval_session* session = session_init(cache_bytes);
+	unique_state unique;
+	lane_group group;
+	char* line = 0;
+	size_t line_size = 0;
+	ssize_t length;
+	expression_node* e;
+	program* prog;
+	
+	// lanes only pay off over the engines and the session, and can't
+	// evaluate a slice
+	int use_lanes = engine_name == 0 && !has_range;
+	
+	group.count = 0;
+	group.groups = 0;
+	group.expressions = 0;
+	
+	memset(&unique, 0, sizeof(unique_state));
+	
+	while ((length = getline(&line, &line_size, f)) != -1)
+	{
+		while (length > 0 && is_whitespace(line[length - 1]))
+		{
+			line[--length] = 0;
+		}
+		
+		if (length == 0)
+		{
+			continue;
+		}
+		
+		if (has_bits_range)
+		{
+			evaluate_widths(line);
+			continue;
+		}
+		
+		if (unique_mode)
+		{
+			evaluate_unique(line, &unique);
+			continue;
+		}
+		
+		if (!use_lanes)
+		{
+			evaluate(line, session, 0, 0);
+			continue;
+		}
+		
+		// expressions of the same shape are held back and evaluated
+		// together, the rest one at a time
+		prog = compile_expression(line, &e, 0);
+		free_expression_node(e);
+		linked_list_free(variable_names);
+		
+		if (!lanes_supports(prog))
+		{
+			program_free(prog);
+			flush_group(&group, session);
+			evaluate(line, session, 0, 0);
+			continue;
+		}
+		
+		if (group.count > 0 && (group.count == LANES_MAX || !lanes_same_shape(group.programs[0], prog)))
+		{
+			flush_group(&group, session);
+		}
+		
+		group.lines[group.count] = strdup(line);
+		group.programs[group.count] = prog;
+		group.count++;
+	}
+	
+	flush_group(&group, session);
+	
+	if (unique_mode)
+	{
+		free_unique(&unique);
+	}
+	
+	elog(LOG_VERBOSE, "session: %llu tables reused, %llu computed\n",
+		(unsigned long long)session->reused, (unsigned long long)session->computed);
+	elog(LOG_VERBOSE, "lanes: %llu expressions in %llu groups\n",
+		(unsigned long long)group.expressions, (unsigned long long)group.groups);
+	
+	if (optimize_programs)
+	{
+		printf_optimize_stats(&optimize_totals);
+	}
+	
+	if (session->cache != 0)
+	{
+		printf_table_cache(session->cache);
+	}
+	
+	free(line);
+	session_free(session);
 }
\ No newline at end of file
@@ -0,0 +1,64 @@
+#ifndef __EVAL_H__
+#define __EVAL_H__
+
+#include <stddef.h>
+#include <stdio.h>
+
+// sets the maximum number of bits in each variable
+void set_max_bits(size_t bits);
+
+// sets the number of threads evaluating the assignments of an expression
+void set_threads(int threads);
+
+// sets the name of the engine used to evaluate expressions, or 0 to pick one
+// based on the expression
+void set_engine(char* name);
+
+// when check is 1, every value produced by the engine is compared against
+// the recursive evaluator, and a mismatch is a fatal error
+void set_check(int check);
+
+// when optimize is 1 (the default), constants are folded, identities are
+// simplified and repeated subexpressions are computed once before an
+// expression is evaluated, see optimize.h
+void set_optimize(int optimize);
+
+// when tree is 1, the tree fingerprint (see tree.h) is printed after the md5
+void set_tree(int tree);
+
+// when fast is 1, the fast fingerprint of the packed values (see
+// fingerprint.h) is printed instead of the md5 of their text
+void set_fast_fingerprint(int fast);
+
+// evaluates only the assignments START to END-1 given as "START:END", and
+// prints the nodes of the tree fingerprint they cover instead of the md5.
+// START and END must be multiples of TREE_CHUNK_SIZE, except that END may be
+// the number of assignments.
+void set_range(char* range);
+
+// evaluates every width LOW to HIGH given as "LOW-HIGH" instead of max_bits,
+// and prints the md5 of each. Expressions whose low bits only depend on the
+// low bits of the variables are evaluated once, at HIGH.
+void set_bits_range(char* range);
+
+// parses, evaluates and prints an expression, and its md5
+void eval_main(char* expr);
+
+// sets the memory limit of the subtree cache used by eval_batch, 0 turns
+// the cache off
+void set_cache_size(size_t megabytes);
+
+// when unique is 1, eval_batch prints only "eval class: LINE" for each
+// expression, the line of the first expression with the same values.
+// Expressions are compared at a few probe assignments first, and only
+// evaluated in full where those agree.
+void set_unique(int unique);
+
+// evaluates every expression in a file, one per line, like eval_main. The
+// truth tables of each expression are kept for the next one, so runs of
+// similar expressions (as written by gen) only compute what changed. Runs
+// of expressions that only differ in their operators are read ahead and
+// evaluated together, see lanes.h.
+void eval_batch(FILE* f);
+
+#endif
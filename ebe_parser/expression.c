@@ -336,15 +336,17 @@ static void free_symbol(symbol* s)
 		return;
 	}
 	
-	if (s->value != 0)
+	// a symbol that isn't allocated points to a value owned
+	// by another symbol, don't free it here
+	if (s->value != 0 && s->allocated == 1)
 	{
-		if (s->allocated == 1 && *(s->value) != 0)
+		if (*(s->value) != 0)
 		{
 			free(*(s->value));
-			s->allocated = 0;
 		}
 		
 		free(s->value);
+		s->allocated = 0;
 	}
 	
 	free(s);
@@ -0,0 +1,179 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "fingerprint.h"
+#include "log.h"
+
+#define C1 0x87c37b91114253d5ULL
+#define C2 0x4cf5ad432745937fULL
+
+static uint64_t rotl64(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t fmix64(uint64_t k)
+{
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdULL;
+	k ^= k >> 33;
+	k *= 0xc4ceb9fe1a85ec53ULL;
+	k ^= k >> 33;
+
+	return k;
+}
+
+static void stream_init(fingerprint_stream* s, uint64_t seed)
+{
+	s->h1 = seed;
+	s->h2 = seed;
+	s->used = 0;
+	s->word = 0;
+	s->fill = 0;
+}
+
+// the block function of MurmurHash3 x64_128
+static void stream_mix(fingerprint_stream* s)
+{
+	uint64_t k1 = s->block[0];
+	uint64_t k2 = s->block[1];
+
+	k1 *= C1;
+	k1 = rotl64(k1, 31);
+	k1 *= C2;
+	s->h1 ^= k1;
+
+	s->h1 = rotl64(s->h1, 27);
+	s->h1 += s->h2;
+	s->h1 = s->h1 * 5 + 0x52dce729;
+
+	k2 *= C2;
+	k2 = rotl64(k2, 33);
+	k2 *= C1;
+	s->h2 ^= k2;
+
+	s->h2 = rotl64(s->h2, 31);
+	s->h2 += s->h1;
+	s->h2 = s->h2 * 5 + 0x38495ab5;
+}
+
+static void stream_word(fingerprint_stream* s, uint64_t w)
+{
+	s->block[s->used++] = w;
+
+	if (s->used == 2)
+	{
+		stream_mix(s);
+		s->used = 0;
+	}
+}
+
+// packs what is left, and fills up the last block with zero words
+static void stream_finish(fingerprint_stream* s)
+{
+	if (s->fill > 0)
+	{
+		stream_word(s, s->word);
+		s->fill = 0;
+	}
+
+	while (s->used != 0)
+	{
+		stream_word(s, 0);
+	}
+}
+
+void fingerprint_init(fingerprint* f, uint32_t bits)
+{
+	if (bits < 1 || bits > 32)
+	{
+		elog(LOG_FATAL_ERROR, "fingerprint_init: bits must be 1 to 32, got %d\n", (int)bits);
+	}
+
+	f->bits = bits;
+	f->mask = bits == 32 ? 0xffffffffULL : (1ULL << bits) - 1;
+	f->count = 0;
+
+	stream_init(&f->values, 0);
+	stream_init(&f->nan, 0);
+}
+
+void fingerprint_add(fingerprint* f, const int32_t* values, const uint8_t* nan, uint64_t count)
+{
+	// the words being packed are kept in locals while the values are added
+	uint64_t word = f->values.word;
+	uint32_t fill = f->values.fill;
+	uint64_t nan_word = f->nan.word;
+	uint32_t nan_fill = f->nan.fill;
+	uint32_t bits = f->bits;
+	uint64_t v;
+	uint64_t j;
+
+	for (j=0; j<count; j++)
+	{
+		v = nan[j] ? 0 : (uint64_t)(uint32_t)values[j] & f->mask;
+
+		word |= v << fill;
+		fill += bits;
+
+		if (fill >= 64)
+		{
+			stream_word(&f->values, word);
+			fill -= 64;
+			word = fill > 0 ? v >> (bits - fill) : 0;
+		}
+
+		nan_word |= (uint64_t)(nan[j] != 0) << nan_fill;
+
+		if (++nan_fill == 64)
+		{
+			stream_word(&f->nan, nan_word);
+			nan_word = 0;
+			nan_fill = 0;
+		}
+	}
+
+	f->values.word = word;
+	f->values.fill = fill;
+	f->nan.word = nan_word;
+	f->nan.fill = nan_fill;
+	f->count += count;
+}
+
+void fingerprint_final(fingerprint* f, unsigned char result[16])
+{
+	fingerprint_stream s;
+	uint64_t h1;
+	uint64_t h2;
+	int i;
+
+	stream_finish(&f->values);
+	stream_finish(&f->nan);
+
+	stream_init(&s, f->bits);
+	stream_word(&s, f->values.h1);
+	stream_word(&s, f->values.h2);
+	stream_word(&s, f->nan.h1);
+	stream_word(&s, f->nan.h2);
+
+	// the finalization of MurmurHash3 x64_128, with the number of values
+	// as the length
+	h1 = s.h1 ^ f->count;
+	h2 = s.h2 ^ f->count;
+
+	h1 += h2;
+	h2 += h1;
+
+	h1 = fmix64(h1);
+	h2 = fmix64(h2);
+
+	h1 += h2;
+	h2 += h1;
+
+	for (i=0; i<8; i++)
+	{
+		result[i] = (unsigned char)(h1 >> (8 * i));
+		result[8 + i] = (unsigned char)(h2 >> (8 * i));
+	}
+}
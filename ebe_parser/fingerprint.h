@@ -0,0 +1,57 @@
+#ifndef __FINGERPRINT_H__
+#define __FINGERPRINT_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Fast fingerprint of the values of an expression, an alternative to the
+// md5 of their "%d," text. The values are packed, bits bits each, into
+// little endian 64 bit words, with nan values packed as 0. A second stream
+// of words holds a bitmap of which values are nan. Each stream is hashed
+// with the block function of MurmurHash3 x64_128, 128 bits at a time, the
+// last block filled up with zero words. The two hashes and the number of
+// values are hashed once more, seeded with bits, into the fingerprint,
+// printed as
+//
+//   eval hash: HASH
+//
+// It isn't cryptographic, and isn't comparable to the md5 of the values.
+
+// one stream of words being hashed
+typedef struct fingerprint_stream
+{
+	uint64_t h1;
+	uint64_t h2;
+
+	// the block being filled
+	uint64_t block[2];
+	size_t used;
+
+	// word being packed, and its number of bits so far
+	uint64_t word;
+	uint32_t fill;
+
+} fingerprint_stream;
+
+typedef struct fingerprint
+{
+	uint32_t bits;
+	uint64_t mask;
+	uint64_t count;
+
+	fingerprint_stream values;
+	fingerprint_stream nan;
+
+} fingerprint;
+
+// Starts a fingerprint of values of bits bits (1 to 32)
+void fingerprint_init(fingerprint* f, uint32_t bits);
+
+// Adds count values, in order of the assignments. Where nan[j] isn't 0 the
+// value is nan.
+void fingerprint_add(fingerprint* f, const int32_t* values, const uint8_t* nan, uint64_t count);
+
+// Writes the fingerprint of every value added to result
+void fingerprint_final(fingerprint* f, unsigned char result[16]);
+
+#endif
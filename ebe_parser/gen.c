@@ -4,26 +4,18 @@
 #include <argp.h>
 
 #include "helper.h"
-#include "A193023.h"
+#include "partition.h"
 
 // user guide for uthash at
 // http://troydhanson.github.io/uthash/userguide.html
 #include "uthash.h"
 
-// max paren depth is implicitly 127 as the paren_state array uses signed char
-
 // buffer output size
 #define MAX_OUTPUT_STR_LEN 1024
 
 // grammar is something like
 // open SYM close [op open SYM close [...]]
 
-#define POSITION_STATE_OPEN 0
-#define POSITION_STATE_SYM 1
-#define POSITION_STATE_CLOSE 2
-
-#define POSITION_STATE_OP 3
-
 // symbols are 'a', 'b', 'c', ... 'z', 'aa', 'ab', ... 'zy', 'zz'
 #define MAX_SYMBOLS 677
 
@@ -39,14 +31,23 @@ struct arguments
         uint64_t starting_id_b;
         uint64_t starting_id_c;
         uint64_t starting_id_d;
+        // which starting ids were given, 0 is a valid one
+        int given_a;
+        int given_b;
+        int given_c;
+        int given_d;
         uint32_t number_variable_slots;
+        char* unary_operators;
+        char* binary_operators;
+        char* id;
+        char* shard;
 };
 
 // id will be given as 
 // n.a.b.c.d
 // where
 // n is the number of variable slots
-// a is the interation for parentheses
+// a is the iteration for the shape of the expression tree
 // b is the iteration for variables
 // c is the iteration for unary operators
 // d is the iteration for binary operators
@@ -58,305 +59,581 @@ uint64_t id_b;
 uint64_t id_c;
 uint64_t id_d;
 
-uint64_t starting_id_a;
-uint64_t starting_id_b;
-uint64_t starting_id_c;
-uint64_t starting_id_d;
+// Where generation starts, as the rank (id less one) of the first
+// expression in each phase, and how many expressions are left to generate.
+// Every phase has the same number of iterations under each iteration of the
+// phase before, so any id, or the rank of an expression among all of them,
+// splits straight into these without iterating.
+uint64_t start_a;
+uint64_t start_b;
+uint64_t start_c;
+uint64_t start_d;
+uint64_t remaining = UINT64_MAX;
+
+// id_b of the first partition, less one
+uint64_t id_b_offset;
 
 uint32_t number_variable_slots;
 
+// 0 for no output, 1 for each expression, 2 for verbose
+int log_level;
+
+// partition of the symbols into variables, set up once for phase_2
+partition variables;
+
+// operators placed by phase_3 and phase_4, in the order they are iterated
+char* unary_operators = "`~";
+char* binary_operators = "*/%+-<>&^|";
+
 uint32_t phase_1_first;
 uint32_t phase_2_first;
 uint32_t phase_3_first;
 uint32_t phase_4_first;
 
-// d is the iteration for binary operators
-void phase_4()
+// a is the iteration for the shape of the expression
+//
+// A shape is a binary tree with n leaves, the symbols, and n-1 inner nodes,
+// the operators. It is held as its preorder bits, 1 for an operator and 0
+// for a symbol, 2n-1 bits in all. Every shape is a different tree, where
+// placing parentheses in a flat expression gave the same tree many times.
+// Shapes are rendered with parentheses around every operator but the root,
+//
+//   ( s : s ) : s
+//
+// only when they are output.
+//
+// Shapes are generated in increasing order of their bits, from the right
+// comb s : ( s : ( ... ) ) to the left comb. id_a is 1 plus the rank of the
+// shape in that order, so there are catalan(n-1) of them. This replaced
+// numbering the placements of parentheses, see doc for the old ids.
+typedef struct tree_shape
 {
+        // number of symbols
+        size_t n;
+
+        // preorder bits, 2n-1 of them
+        size_t len;
+        uint8_t* bits;
+
+        // completions[ones * (n+1) + zeros] is the number of ways to finish
+        // a shape with that many ones and zeros left
+        uint64_t* completions;
+
+        // operators being rendered, how many of their operands are done,
+        // and their number in preorder among the operators
+        uint8_t* done;
+        uint32_t* inner;
+
+} tree_shape;
+
+// shape being generated, set up once for phase_1
+tree_shape shape;
+
+// Whether a symbol can come next, with ones operators and zeros symbols left
+static int tree_leaf_fits(size_t ones, size_t zeros)
+{
+        // the symbols still needed are zeros - ones, and if operators are
+        // left it can't be the last one
+        return zeros > 0 && (ones == 0 || zeros >= ones + 2);
 }
 
-// c is the iteration for unary operators
-void phase_3()
+static uint64_t tree_completions(tree_shape* t, size_t ones, size_t zeros)
 {
+        return t->completions[ones * (t->n + 1) + zeros];
 }
 
-// b is the iteration for variables
-// number of possible combinations is described by the catalan numbers
-// the variableto use in each position is described by the sequence https://oeis.org/A071159
-void phase_2(char * expression)
+// Sets the bits from position p on to the least completion, with ones
+// operators and zeros symbols left
+static void tree_fill(tree_shape* t, size_t p, size_t ones, size_t zeros)
 {
-        // overflow for calculating max values
-        uint32_t overflow = 0;
-        
-        // output buffer
-        uint8_t output_string[MAX_OUTPUT_STR_LEN];
-        
-        // position in output buffer
-        size_t output_string_position = 0;
-        
-        // position in input buffer
-        size_t input_string_position = 0;
-        
-        uint64_t variable_position;
-        
-        // iterating over input
-        char ch;
-        
-        // this is going to be an array which holds the count (current value) for the variable
-        // in each position it may occur in. This will be resolved to a position in the
-        // available_symbols
-        uint32_t* variable_state = (uint32_t*)malloc(sizeof(uint32_t)* number_variable_slots);
-        memset(variable_state, 0, sizeof(uint32_t) * number_variable_slots);
-        
-        uint64_t max_n = get_bell_sum((uint64_t)number_variable_slots);
-        max_n++;
-        
-        uint64_t i,j;
-        
-        if (phase_2_first == 0)
+        for (; p < t->len; p++)
         {
-                phase_2_first = 1;
-
-                id_b = starting_id_b;
-                
-                if (starting_id_b > 0)
+                if (tree_leaf_fits(ones, zeros))
                 {
-                        id_b = starting_id_b;
+                        t->bits[p] = 0;
+                        zeros--;
                 }
                 else
                 {
-                        id_b = get_bell_sum(number_variable_slots - 1);
+                        t->bits[p] = 1;
+                        ones--;
                 }
         }
-        else
+}
+
+// Sets the bits to the shape of rank rank
+static void tree_unrank(tree_shape* t, uint64_t rank)
+{
+        size_t ones = t->n - 1;
+        size_t zeros = t->n;
+        uint64_t count;
+        size_t p;
+
+        for (p = 0; p < t->len; p++)
         {
-                // starts at one before the first item
-                id_b = get_bell_sum(number_variable_slots - 1);
+                if (tree_leaf_fits(ones, zeros))
+                {
+                        count = tree_completions(t, ones, zeros - 1);
+
+                        if (rank < count)
+                        {
+                                t->bits[p] = 0;
+                                zeros--;
+                                continue;
+                        }
+
+                        rank -= count;
+                }
+
+                t->bits[p] = 1;
+                ones--;
         }
-        
-        node_description* node = 0;
+}
 
-        id_b++;
-        
-        node = A193023((uint64_t)id_b);
-        
-        while (id_b < max_n)
-        {      
-                memset(output_string, 0, MAX_OUTPUT_STR_LEN);
-                output_string_position = 0;
-                input_string_position = 0;
-                
-                variable_position = 0;
-                
-                for(i=0; i < node->len + 1; i++)
+// Steps to the next shape. Returns 0 if there is none.
+static int tree_next(tree_shape* t)
+{
+        size_t ones = 0;
+        size_t p = t->len;
+
+        // the last symbol with an operator after it becomes an operator,
+        // everything after it is filled in again
+        while (p-- > 0)
+        {
+                if (t->bits[p] == 1)
+                {
+                        ones++;
+                }
+                else if (ones > 0)
+                {
+                        t->bits[p] = 1;
+                        tree_fill(t, p + 1, ones - 1, t->len - p - ones);
+                        return 1;
+                }
+        }
+
+        return 0;
+}
+
+// Renders the shape to output, which has to hold MAX_OUTPUT_STR_LEN bytes.
+// Symbols are " s ", or when blocks isn't 0 the variable of each symbol's
+// block, in order. Operators are " : ". When unary isn't 0 each node, in
+// preorder, is preceded by its unary operator, and when operators isn't 0
+// the position of the ':' of each operator is written to it.
+static void tree_render(tree_shape* t, uint32_t* blocks, uint8_t* unary, uint8_t* output, size_t* operators)
+{
+        size_t position = 0;
+        size_t depth = 0;
+        size_t leaf = 0;
+        uint32_t inner = 0;
+        size_t len;
+        const char* symbol;
+        size_t p;
+
+        // a unary operator on the root needs parentheses the root doesn't have
+        int wrapped = unary != 0 && unary[0] != 0 && t->bits[0] == 1;
+
+        for (p = 0; p < t->len; p++)
+        {
+                if (unary != 0 && unary[p] != 0)
+                        output[position++] = unary_operators[unary[p] - 1];
+
+                if (t->bits[p] == 1)
+                {
+                        if (depth > 0 || wrapped)
+                                output[position++] = '(';
+
+                        t->done[depth] = 0;
+                        t->inner[depth++] = inner++;
+                        continue;
+                }
+
+                if (blocks == 0)
+                {
+                        memcpy(output + position, " s ", 3);
+                        position += 3;
+                }
+                else
+                {
+                        symbol = available_symbols[blocks[leaf] + 1];
+                        len = strlen(symbol);
+                        memcpy(output + position, symbol, len);
+                        position += len;
+                }
+
+                leaf++;
+
+                // close the operators whose right operand this ends
+                while (depth > 0)
                 {
-                        variable_state[i] = node->values[i] + 1;
+                        if (t->done[depth - 1]++ == 0)
+                        {
+                                // : for operator
+                                if (operators != 0)
+                                        operators[t->inner[depth - 1]] = position + 1;
+
+                                memcpy(output + position, " : ", 3);
+                                position += 3;
+                                break;
+                        }
+
+                        depth--;
+
+                        if (depth > 0 || wrapped)
+                                output[position++] = ')';
                 }
-                
-                do
+        }
+
+        output[position] = 0;
+}
+
+static void tree_init(tree_shape* t, size_t n)
+{
+        size_t ones;
+        size_t zeros;
+        uint64_t count;
+
+        t->n = n;
+        t->len = 2 * n - 1;
+        t->bits = (uint8_t*)malloc(sizeof(uint8_t) * t->len);
+        t->done = (uint8_t*)malloc(sizeof(uint8_t) * n);
+        t->inner = (uint32_t*)malloc(sizeof(uint32_t) * n);
+        t->completions = (uint64_t*)malloc(sizeof(uint64_t) * n * (n + 1));
+
+        if (t->bits == 0 || t->done == 0 || t->inner == 0 || t->completions == 0)
+        {
+                printf("out of memory (phase_1).\n");
+                exit(1);
+        }
+
+        for (ones = 0; ones < n; ones++)
+        {
+                for (zeros = 0; zeros <= n; zeros++)
                 {
-                        ch = expression[input_string_position++];
-                        
-                        if (ch != 's')
+                        if (ones == 0)
                         {
-                                output_string[output_string_position++] = ch;
+                                count = 1;
                         }
                         else
                         {
-                                 strcat((char*)(output_string + output_string_position), available_symbols[variable_state[variable_position]]);
-                                 output_string_position += strlen(available_symbols[variable_state[variable_position]]);
-                                 
-                                 variable_position++;
+                                count = tree_completions(t, ones - 1, zeros);
+
+                                if (tree_leaf_fits(ones, zeros))
+                                {
+                                        count += tree_completions(t, ones, zeros - 1);
+
+                                        if (count < tree_completions(t, ones, zeros - 1))
+                                        {
+                                                printf("too many combinations (phase_1).\n");
+                                                exit(1);
+                                        }
+                                }
                         }
+
+                        t->completions[ones * (n + 1) + zeros] = count;
                 }
-                while (ch != 0);
-                
-                printf("phase_2: %d.%d.%d: %s\n", number_variable_slots, id_a, id_b, output_string);
-                
-                id_b++;
-                node_next(node);
         }
-        
-        node_free(node);
 }
 
-// a is the iteration for parentheses
-void phase_1()
+static void tree_free(tree_shape* t)
+{
+        free(t->bits);
+        free(t->done);
+        free(t->inner);
+        free(t->completions);
+}
+
+// Operators of the expression being generated, set up once for phase_3
+// and phase_4, so nothing is allocated per expression
+typedef struct operator_state
+{
+        // unary operator of each node in preorder, 0 for none, otherwise 1
+        // plus its index in unary_operators
+        size_t nodes;
+        uint8_t* unary;
+        uint64_t unary_count;
+
+        // binary operator of each operator node in preorder, its index in
+        // binary_operators
+        size_t inner;
+        uint8_t* binary;
+        uint64_t binary_count;
+
+        // the expression, and where the character of each binary operator is
+        uint8_t expression[MAX_OUTPUT_STR_LEN];
+        size_t length;
+        size_t* position;
+
+} operator_state;
+
+operator_state operators;
+
+static void operators_init(operator_state* o, size_t n)
 {
-        // overflow for calculating max values
         uint32_t overflow = 0;
-        
-        // output buffer
-        uint8_t output_string[MAX_OUTPUT_STR_LEN];
-        
-        // position in output buffer
-        size_t output_string_position = 0;
-        
-        // max consecutive parentheses in a single slot
-        size_t max_paren_in_slot = number_variable_slots - 1;
-        
-        // max number of slots in the expression to place a paren
-        size_t num_paren_slots = number_variable_slots * 2;
 
-        // hard-coded number of states, described by the grammar
-        size_t max_states_in_iteration = 3;
-        if (number_variable_slots > 1)
+        o->nodes = 2 * n - 1;
+        o->inner = n - 1;
+        o->unary = (uint8_t*)calloc(o->nodes, sizeof(uint8_t));
+        o->binary = (uint8_t*)calloc(n, sizeof(uint8_t));
+        o->position = (size_t*)calloc(n, sizeof(size_t));
+
+        if (o->unary == 0 || o->binary == 0 || o->position == 0)
         {
-                max_states_in_iteration += 4 * (number_variable_slots - 1);
+                printf("out of memory (operators_init).\n");
+                exit(1);
         }
 
-        size_t state = 0;
-        size_t state_count = 0;
-        size_t i;
-        size_t j;
+        o->unary_count = lazy_pow(strlen(unary_operators) + 1, o->nodes, &overflow);
 
-        // this is going to be an array which holds the count of parentheses in each "slot."
-        // A slot would be a valid location for a paren to show up, which is to the left
-        // or right of any symbol
-        uint8_t* paren_state = (uint8_t*)malloc(sizeof(uint8_t)* num_paren_slots);
-        memset(paren_state, 0, sizeof(uint8_t) * num_paren_slots);
+        if (overflow)
+        {
+                printf("too many combinations (phase_3).\n");
+                exit(1);
+        }
+
+        o->binary_count = lazy_pow(strlen(binary_operators), o->inner, &overflow);
 
-        size_t max_combinations = lazy_pow(number_variable_slots, num_paren_slots, &overflow);
-        
         if (overflow)
         {
-                printf("too many compbinations (phase_1).\n");
+                printf("too many combinations (phase_4).\n");
                 exit(1);
         }
+}
 
-        if (starting_id_a > 0)
+static void operators_free(operator_state* o)
+{
+        free(o->unary);
+        free(o->binary);
+        free(o->position);
+}
+
+// Steps the count digits, in base radix with the last digit the fastest, to
+// the next number. Returns how many digits changed, or 0 after the last
+// number, when they are all back to 0.
+static size_t odometer_next(uint8_t* digits, size_t count, size_t radix)
+{
+        size_t k = count;
+
+        while (k-- > 0)
         {
-                id_a = starting_id_a;
+                if (++digits[k] < radix)
+                        return count - k;
 
-                // convert starting a into base max_paren_in_slot
-                // and set initial values
-                uint64_t t = starting_id_a;
-                j=0;
-                while (t != 0)
-                {
-                        paren_state[j] = t % (max_paren_in_slot + 1);
-                        t /= (max_paren_in_slot + 1);
-                        j++;
-                }
+                digits[k] = 0;
         }
-        else
+
+        return 0;
+}
+
+// Sets the count digits, in base radix, to rank
+static void odometer_unrank(uint8_t* digits, size_t count, size_t radix, uint64_t rank)
+{
+        size_t k = count;
+
+        while (k-- > 0)
+        {
+                digits[k] = rank % radix;
+                rank /= radix;
+        }
+}
+
+// Writes value in decimal, returns the number of characters
+static size_t decimal_text(uint8_t* output, uint64_t value)
+{
+        uint8_t digits[20];
+        size_t count = 0;
+        size_t i;
+
+        do
         {
-                id_a = 0;
+                digits[count++] = '0' + value % 10;
+                value /= 10;
         }
+        while (value != 0);
 
-        if (overflow)
+        for (i = 0; i < count; i++)
         {
-                printf("Can't find begining id (too many combinations).\n");
-                exit(1);
+                output[i] = digits[count - 1 - i];
+        }
+
+        return count;
+}
+
+// d is the iteration for binary operators
+//
+// Every operator node gets one of binary_operators, in the order of that
+// string, the operator nodes taken in preorder with the last the fastest.
+// id_d is 1 plus that number in base strlen(binary_operators). Only the
+// operator characters that change are written between one expression and
+// the next.
+void phase_4()
+{
+        // output line
+        uint8_t line[MAX_OUTPUT_STR_LEN + 128];
+        size_t prefix;
+        size_t length;
+
+        size_t radix = strlen(binary_operators);
+        uint64_t rank = 0;
+        size_t changed;
+        size_t k;
+        int more = 1;
+
+        if (phase_4_first == 0)
+        {
+                phase_4_first = 1;
+                rank = start_d;
         }
 
-        size_t iter_count = 0;
-        size_t open_count, close_count;
-        size_t double_open, double_close;
+        odometer_unrank(operators.binary, operators.inner, radix, rank);
+        id_d = rank;
 
-        while (id_a < max_combinations)
+        for (k = 0; k < operators.inner; k++)
         {
-                id_a++;
+                operators.expression[operators.position[k]] = binary_operators[operators.binary[k]];
+        }
 
-                open_count = 0;
-                close_count = 0;
+        prefix = sprintf((char*)line, "phase_4: %d.%llu.%llu.%llu.", number_variable_slots,
+                (unsigned long long)id_a, (unsigned long long)id_b, (unsigned long long)id_c);
 
-                double_open = 0;
-                double_close = 0;
+        while (more && remaining > 0)
+        {
+                id_d++;
+                remaining--;
 
-                // a couple quick checks
-                for (i=0; i<num_paren_slots; i += 2)
+                if (log_level > 0)
                 {
-                        // ignore open sym close, such as: (SYM), ((SYM)), etc
-                        // and more generally, all cases where there are both open and close parentheses around a symbol
-                        if (paren_state[i] > 0 && paren_state[i+1] > 0)
-                                goto inc_paren_state;
+                        length = prefix + decimal_text(line + prefix, id_d);
+                        line[length++] = ':';
+                        line[length++] = ' ';
+                        memcpy(line + length, operators.expression, operators.length);
+                        length += operators.length;
+                        line[length++] = '\n';
+
+                        fwrite(line, 1, length, stdout);
+                }
 
-                        // Count number of open and close totals to make sure they match
-                        open_count += paren_state[i];
-                        close_count += paren_state[i+1];
+                changed = odometer_next(operators.binary, operators.inner, radix);
 
-                        if (paren_state[i] == 2)
-                                double_open++;
+                for (k = operators.inner - changed; k < operators.inner; k++)
+                {
+                        operators.expression[operators.position[k]] = binary_operators[operators.binary[k]];
+                }
 
-                        if (paren_state[i+1] == 2)
-                                double_close++;
+                more = changed > 0;
+        }
+}
 
-                        // can't have a closing paren before an open
-                        if (close_count > open_count)
-                                goto inc_paren_state;
-                }
+// c is the iteration for unary operators
+//
+// Every node of the shape, symbol or operator, gets no unary operator or
+// one of unary_operators, in the order of that string, the nodes taken in
+// preorder with the last the fastest. id_c is 1 plus that number in base
+// strlen(unary_operators) + 1. A node gets at most one unary operator, so
+// none are doubled up like ~~, which doesn't parse.
+void phase_3(tree_shape* shape)
+{
+        size_t radix = strlen(unary_operators) + 1;
+        uint64_t rank = 0;
+        int more = 1;
 
-                // ignore mismatch totals
-                if (close_count != open_count)
-                        goto inc_paren_state;
- 
-                // ignore simple double paren groups, it will be covered by a single paren group
-                // Note: this only skips if there are no single parentheses
-                if (double_open > 0 && double_open == double_close && open_count == double_open * 2)
-                        goto inc_paren_state;
-                
-                
-                // alright, onto to displaying the current item
-
-                iter_count = num_paren_slots - 1;
-
-                memset(output_string, 0, MAX_OUTPUT_STR_LEN);
-                output_string_position = 0;
-
-                state = POSITION_STATE_OPEN;
-                for (state_count = 0; state_count < max_states_in_iteration; state_count++)
+        if (phase_3_first == 0)
+        {
+                phase_3_first = 1;
+                rank = start_c;
+        }
+
+        odometer_unrank(operators.unary, operators.nodes, radix, rank);
+        id_c = rank;
+
+        while (more && remaining > 0)
+        {
+                id_c++;
+
+                // rendered with : for the binary operators, which phase_4 fills in
+                if (log_level > 0)
                 {
-                        switch(state)
-                        {
-                                case POSITION_STATE_OPEN :
-                                        for(i=0; i<paren_state[iter_count]; i++)
-                                        {
-                                                strcat((char*)(output_string + output_string_position), "(");
-                                                output_string_position++;
-                                        }
-                                        iter_count--;
-                                break;
-                                case POSITION_STATE_SYM :
-                                        // s for symbol
-                                        strcat((char*)(output_string + output_string_position), " s ");
-                                        output_string_position += 3;
-                                break;
-                                case POSITION_STATE_CLOSE :
-                                        for(i=0; i<paren_state[iter_count]; i++)
-                                        {
-                                                strcat((char*)(output_string + output_string_position), ")");
-                                                output_string_position++;
-                                        }
-                                        iter_count--;
-                                break;
-                                case POSITION_STATE_OP :
-                                        // : for operator
-                                        strcat((char*)(output_string + output_string_position), " : ");
-                                        output_string_position += 3;
-                                break;
-                        }
+                        tree_render(shape, variables.rgs, operators.unary, operators.expression, operators.position);
+                        operators.length = strlen((char*)operators.expression);
+                }
+
+                if (log_level > 1)
+                        printf("phase_3: %d.%llu.%llu.%llu: %s\n", number_variable_slots, (unsigned long long)id_a,
+                                (unsigned long long)id_b, (unsigned long long)id_c, operators.expression);
+
+                phase_4();
 
-                        state = state + 1;
-                        state = state % 4;    
+                more = odometer_next(operators.unary, operators.nodes, radix) > 0;
+        }
+}
+
+// b is the iteration for variables
+//
+// Variables are given to the symbols by a set partition of the symbols, as
+// a restricted growth string: the symbols in the first block are a, in the
+// next b, and so on. Partitions are visited in increasing order of their
+// strings, aaa, aab, aba, abb, abc, and id_b is their index in
+// https://oeis.org/A193023, which lists the partitions of 1, 2, 3, ...
+// symbols one after another,
+//
+//   id_b = bell(1) + ... + bell(n-1) + 1 + rank
+void phase_2(tree_shape* shape)
+{
+        // output buffer
+        uint8_t output_string[MAX_OUTPUT_STR_LEN];
+
+        uint64_t rank = 0;
+        int more = 1;
+
+        if (phase_2_first == 0)
+        {
+                phase_2_first = 1;
+                rank = start_b;
+        }
+
+        partition_unrank(&variables, rank);
+        id_b = id_b_offset + rank;
+
+        while (more && remaining > 0)
+        {
+                id_b++;
+
+                if (log_level > 1)
+                {
+                        tree_render(shape, variables.rgs, 0, output_string, 0);
+                        printf("phase_2: %d.%llu.%llu: %s\n", number_variable_slots, (unsigned long long)id_a, (unsigned long long)id_b, output_string);
                 }
 
-                printf("phase_1: %d.%d: %s\n", number_variable_slots, id_a, output_string);
-                phase_2(output_string);
+                phase_3(shape);
 
-inc_paren_state:
-                j=0;
-                while(1)
+                more = partition_next(&variables);
+        }
+}
+
+void phase_1()
+{
+        // output buffer
+        uint8_t output_string[MAX_OUTPUT_STR_LEN];
+
+        int more = 1;
+
+        tree_unrank(&shape, start_a);
+        id_a = start_a;
+
+        while (more && remaining > 0)
+        {
+                id_a++;
+
+                if (log_level > 1)
                 {
-                        paren_state[j] = paren_state[j] + 1;
-                        if (paren_state[j] > max_paren_in_slot)
-                                paren_state[j] = 0;
-                        else
-                                break;
-                        j++;
-                        if (j > num_paren_slots)
-                                break;
+                        tree_render(&shape, 0, 0, output_string, 0);
+                        printf("phase_1: %d.%llu: %s\n", number_variable_slots, (unsigned long long)id_a, output_string);
                 }
+
+                phase_2(&shape);
+
+                more = tree_next(&shape);
         }
 }
 
@@ -373,10 +650,22 @@ static char doc[] =
         "n.a.b.c.d\n"
         "where\n"
         "n is the number of variable slots\n"
-        "a is the iteration for parentheses\n"
+        "a is the iteration for the shape of the expression tree\n"
         "b is the iteration for variables\n"
         "c is the iteration for unary operators\n"
-        "d is the iteration for binary operators";
+        "d is the iteration for binary operators\n"
+        "Expressions are output as phase_4: n.a.b.c.d: EXPR, the other\n"
+        "phases are output with --verbose\n"
+        "\n"
+        "There are catalan(n-1) shapes. A shape is read as its preorder bits,\n"
+        "1 for an operator and 0 for a symbol, and a is 1 plus its rank in\n"
+        "increasing order of those bits, from the right comb to the left comb:\n"
+        "  4.1: s : (s : (s : s))    4.2: s : ((s : s) : s)\n"
+        "  4.3: (s : s) : (s : s)    4.4: (s : (s : s)) : s\n"
+        "  4.5: ((s : s) : s) : s\n"
+        "a used to number placements of parentheses, several of which gave\n"
+        "the same tree. Those ids don't carry over: an old expression has the\n"
+        "a of the shape it parses to, operators associating to the left";
 	
 /* A description of the arguments we accept. */
 static char args_doc[] = "NUM";
@@ -392,6 +681,10 @@ static struct argp_option options[] = {
         {"id_b",  'b', "NUM",      0,  "Starting id for 'b' part of id (requires a)" },
         {"id_c",  'c', "NUM",      0,  "Starting id for 'c' part of id (requires a,b)" },
         {"id_d",  'd', "NUM",      0,  "Starting id for 'd' part of id (requires a,b,c)" },
+        {"unary",  'U', "OPS",      0,  "Unary operators to place, default `~ (may be empty)" },
+        {"binary",  'B', "OPS",      0,  "Binary operators to place, default */%+-<>&^|" },
+        {"id",  'i', "ID",      0,  "Output only the expression with id n.a.b.c.d (NUM may be left out)" },
+        {"shard",  'S', "K/N",      0,  "Output only the K-th of N contiguous, equal parts of the ids, K from 1 to N" },
 	{ 0 }
 };
 
@@ -416,15 +709,31 @@ static error_t parse_opt (int key, char *arg, struct argp_state *state)
 			break;
 		case 'a':
 			arguments->starting_id_a = arg ? atol (arg) : 0;
+			arguments->given_a = 1;
 			break;
                 case 'b':
 			arguments->starting_id_b = arg ? atol (arg) : 0;
+			arguments->given_b = 1;
 			break;
                 case 'c':
 			arguments->starting_id_c = arg ? atol (arg) : 0;
+			arguments->given_c = 1;
 			break;
                 case 'd':
 			arguments->starting_id_d = arg ? atol (arg) : 0;
+			arguments->given_d = 1;
+			break;
+                case 'U':
+			arguments->unary_operators = arg;
+			break;
+                case 'B':
+			arguments->binary_operators = arg;
+			break;
+                case 'i':
+			arguments->id = arg;
+			break;
+                case 'S':
+			arguments->shard = arg;
 			break;
 
 		case ARGP_KEY_ARG:
@@ -433,7 +742,7 @@ static error_t parse_opt (int key, char *arg, struct argp_state *state)
 
 		case ARGP_KEY_END:
 		
-			if (state->arg_num < 1)
+			if (state->arg_num < 1 && arguments->id == 0)
 				// Not enough arguments.
 				argp_usage (state);
 			break;
@@ -447,6 +756,26 @@ static error_t parse_opt (int key, char *arg, struct argp_state *state)
 /* Our argp parser. */
 static struct argp argp = { options, parse_opt, args_doc, doc };
 
+// Sets where generation starts from the rank of an expression among all
+// of them, with counts[] the number of iterations of each phase
+static void start_at_rank(uint64_t rank, uint64_t* counts)
+{
+        start_d = rank % counts[3];
+        rank /= counts[3];
+        start_c = rank % counts[2];
+        rank /= counts[2];
+        start_b = rank % counts[1];
+        rank /= counts[1];
+        start_a = rank;
+}
+
+// Rank of the first expression of shard k of shards, total * k / shards
+// without overflowing
+static uint64_t shard_bound(uint64_t total, uint64_t k, uint64_t shards)
+{
+        return total / shards * k + total % shards * k / shards;
+}
+
 int main(int argc, char** argv)
 {
         struct arguments arguments;
@@ -458,36 +787,87 @@ int main(int argc, char** argv)
         arguments.starting_id_b = 0;
         arguments.starting_id_c = 0;
         arguments.starting_id_d = 0;
+        arguments.given_a = 0;
+        arguments.given_b = 0;
+        arguments.given_c = 0;
+        arguments.given_d = 0;
+        arguments.unary_operators = unary_operators;
+        arguments.binary_operators = binary_operators;
+        arguments.id = 0;
+        arguments.shard = 0;
+        arguments.number_variable_slots = 0;
 	
 	/* Parse our arguments; every option seen by parse_opt will
 	be reflected in arguments. */
 	argp_parse (&argp, argc, argv, 0, 0, &arguments);
         
-        if (arguments.starting_id_d > 0 && (arguments.starting_id_c == 0 ||
-                arguments.starting_id_b || 0 && arguments.starting_id_a == 0))
+        if (arguments.given_d && (!arguments.given_c || !arguments.given_b || !arguments.given_a))
         {
                 printf("Using d requires a,b, and c\n");
                 exit(0);
         }
         
-        if (arguments.starting_id_c > 0 &&
-                (arguments.starting_id_b || 0 && arguments.starting_id_a == 0))
+        if (arguments.given_c && (!arguments.given_b || !arguments.given_a))
         {
                 printf("Using c requires a and b\n");
                 exit(0);
         }
         
-        if (arguments.starting_id_b > 0 && arguments.starting_id_a == 0)
+        if (arguments.given_b && !arguments.given_a)
         {
                 printf("Using b requires a\n");
                 exit(0);
         }
         
+        int starting = arguments.given_a || arguments.given_b || arguments.given_c || arguments.given_d;
+
+        if ((arguments.id != 0) + (arguments.shard != 0) + starting > 1)
+        {
+                printf("Use only one of id, shard, and starting ids\n");
+                exit(0);
+        }
+
+        // n.a.b.c.d
+        unsigned int id_n = 0;
+        unsigned long long id[4];
+        int used = 0;
+
+        if (arguments.id != 0)
+        {
+                if (sscanf(arguments.id, "%u.%llu.%llu.%llu.%llu%n", &id_n, &id[0], &id[1], &id[2], &id[3], &used) != 5 ||
+                        arguments.id[used] != 0)
+                {
+                        printf("Id must be given as n.a.b.c.d\n");
+                        exit(0);
+                }
+
+                if (arguments.number_variable_slots != 0 && arguments.number_variable_slots != id_n)
+                {
+                        printf("Id is for %u variables, not %u\n", id_n, arguments.number_variable_slots);
+                        exit(0);
+                }
+
+                arguments.number_variable_slots = id_n;
+        }
+
+        // k/N
+        unsigned long long shard_k = 0;
+        unsigned long long shard_count = 0;
+
+        if (arguments.shard != 0)
+        {
+                if (sscanf(arguments.shard, "%llu/%llu%n", &shard_k, &shard_count, &used) != 2 ||
+                        arguments.shard[used] != 0 || shard_k < 1 || shard_k > shard_count || shard_count > UINT32_MAX)
+                {
+                        printf("Shard must be given as K/N, with K from 1 to N\n");
+                        exit(0);
+                }
+        }
+
+        log_level = arguments.log_level;
         number_variable_slots = arguments.number_variable_slots;
-        starting_id_a = arguments.starting_id_a;
-        starting_id_b = arguments.starting_id_b;
-        starting_id_c = arguments.starting_id_c;
-        starting_id_d = arguments.starting_id_d;
+        unary_operators = arguments.unary_operators;
+        binary_operators = arguments.binary_operators;
         
         if (number_variable_slots == 0)
         {
@@ -501,6 +881,31 @@ int main(int argc, char** argv)
                 exit(0);
         }
         
+        size_t k;
+        for (k=0; unary_operators[k] != 0; k++)
+        {
+                if (is_unary_operator(unary_operators[k]) == 0 || strchr(unary_operators + k + 1, unary_operators[k]) != 0)
+                {
+                        printf("Unary operators must be distinct, from: `~\n");
+                        exit(0);
+                }
+        }
+
+        for (k=0; binary_operators[k] != 0; k++)
+        {
+                if (is_binary_operator(binary_operators[k]) == 0 || strchr(binary_operators + k + 1, binary_operators[k]) != 0)
+                {
+                        printf("Binary operators must be distinct, from: */%%+-<>&^|#$@\n");
+                        exit(0);
+                }
+        }
+
+        if (binary_operators[0] == 0 && number_variable_slots > 1)
+        {
+                printf("Binary operators are needed for more than one variable.\n");
+                exit(0);
+        }
+
         // set up variable names
         uint32_t i;
         for (i=1; i<number_variable_slots+1; i++)
@@ -508,8 +913,90 @@ int main(int argc, char** argv)
                 available_symbols[i] = count_to_var_name(i); 
         }
         
+        tree_init(&shape, number_variable_slots);
+        partition_init(&variables, number_variable_slots);
+        operators_init(&operators, number_variable_slots);
+
+        // iterations of each phase
+        uint64_t counts[4];
+        counts[0] = tree_completions(&shape, shape.n - 1, shape.n);
+        counts[1] = partition_bell(&variables, number_variable_slots);
+        counts[2] = operators.unary_count;
+        counts[3] = operators.binary_count;
+
+        id_b_offset = 0;
+        for (i=1; i<number_variable_slots; i++)
+        {
+                id_b_offset += partition_bell(&variables, i);
+        }
+
+        if (arguments.id != 0)
+        {
+                if (id[0] < 1 || id[0] > counts[0] || id[1] <= id_b_offset || id[1] - id_b_offset > counts[1] ||
+                        id[2] < 1 || id[2] > counts[2] || id[3] < 1 || id[3] > counts[3])
+                {
+                        printf("Id %s is out of range\n", arguments.id);
+                        exit(0);
+                }
+
+                start_a = id[0] - 1;
+                start_b = id[1] - id_b_offset - 1;
+                start_c = id[2] - 1;
+                start_d = id[3] - 1;
+                remaining = 1;
+        }
+        else if (arguments.shard != 0)
+        {
+                uint64_t total = 1;
+
+                for (k=0; k<4; k++)
+                {
+                        if (total > UINT64_MAX / counts[k])
+                        {
+                                printf("too many combinations to shard.\n");
+                                exit(1);
+                        }
+
+                        total *= counts[k];
+                }
+
+                uint64_t begin = shard_bound(total, shard_k - 1, shard_count);
+                uint64_t end = shard_bound(total, shard_k, shard_count);
+
+                start_at_rank(begin, counts);
+                remaining = end - begin;
+        }
+        else
+        {
+                // ids of b begin after id_b_offset, which is the one to give
+                // to start at the first partition
+                if (arguments.given_b && arguments.starting_id_b < id_b_offset)
+                {
+                        printf("Starting id b must be at least %llu for %u variables\n",
+                                (unsigned long long)id_b_offset, number_variable_slots);
+                        exit(0);
+                }
+
+                // each part continues after its starting id
+                start_a = arguments.starting_id_a;
+                start_b = arguments.given_b ? arguments.starting_id_b - id_b_offset : 0;
+                start_c = arguments.starting_id_c;
+                start_d = arguments.starting_id_d;
+
+                if (start_a >= counts[0] || start_b >= counts[1] || start_c >= counts[2] || start_d >= counts[3])
+                {
+                        printf("Starting ids must be before the last id of each part\n");
+                        exit(0);
+                }
+        }
+
         // alright, done with initial parsing and setup, on to phase 1       
-        phase_1();
+        if (remaining > 0)
+                phase_1();
+
+        tree_free(&shape);
+        partition_free(&variables);
+        operators_free(&operators);
 
         return 0;
 }
\ No newline at end of file
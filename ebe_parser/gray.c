@@ -0,0 +1,246 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "gray.h"
+#include "program.h"
+#include "optable.h"
+#include "log.h"
+
+int gray_supports(program* p)
+{
+	return p->bits >= 1 && p->bits <= 32;
+}
+
+void gray_prepare(program* p)
+{
+	gray_plan* plan;
+	uint8_t* depends;
+	instruction* in;
+	size_t i, k;
+	uint32_t count;
+
+	if (p->gray != 0)
+	{
+		return;
+	}
+
+	plan = (gray_plan*)malloc(sizeof(gray_plan));
+	depends = (uint8_t*)malloc(sizeof(uint8_t) * p->length);
+
+	if (plan == 0 || depends == 0)
+	{
+		elog(LOG_FATAL_ERROR, "gray_prepare: out of memory\n");
+	}
+
+	plan->variable_count = p->variable_count;
+	plan->dependents = (uint32_t**)malloc(sizeof(uint32_t*) * (p->variable_count + 1));
+	plan->dependent_count = (uint32_t*)malloc(sizeof(uint32_t) * (p->variable_count + 1));
+
+	if (plan->dependents == 0 || plan->dependent_count == 0)
+	{
+		elog(LOG_FATAL_ERROR, "gray_prepare: out of memory 2\n");
+	}
+
+	for (k=0; k<p->variable_count; k++)
+	{
+		// operands come before the instruction, so one pass in program order
+		// finds everything that depends on the variable
+		count = 0;
+
+		for (i=0; i<p->length; i++)
+		{
+			in = &p->code[i];
+
+			switch (in->op)
+			{
+				case op_const:
+					depends[i] = 0;
+					break;
+				case op_var:
+					depends[i] = in->a == k;
+					break;
+				case op_minus:
+				case op_negate:
+					depends[i] = depends[in->a];
+					break;
+				default:
+					depends[i] = depends[in->a] | depends[in->b];
+					break;
+			}
+
+			if (depends[i])
+			{
+				count++;
+			}
+		}
+
+		plan->dependent_count[k] = count;
+		plan->dependents[k] = (uint32_t*)malloc(sizeof(uint32_t) * (count + 1));
+
+		if (plan->dependents[k] == 0)
+		{
+			elog(LOG_FATAL_ERROR, "gray_prepare: out of memory 3\n");
+		}
+
+		count = 0;
+
+		for (i=0; i<p->length; i++)
+		{
+			if (depends[i])
+			{
+				plan->dependents[k][count++] = (uint32_t)i;
+			}
+		}
+	}
+
+	free(depends);
+
+	p->gray = plan;
+}
+
+// runs a single instruction. nan is tracked per register, so a register
+// that isn't run again keeps its nan along with its value.
+static void run_instruction(program* p, uint32_t i, const uint32_t* vars, uint32_t* regs, uint8_t* nans)
+{
+	instruction* in = &p->code[i];
+	uint32_t a = regs[in->a];
+	uint32_t b = regs[in->b];
+	uint32_t v = 0;
+	int32_t is_nan = 0;
+
+	switch (in->op)
+	{
+		case op_const:
+			regs[i] = in->a;
+			nans[i] = 0;
+			return;
+		case op_var:
+			regs[i] = vars[in->a];
+			nans[i] = 0;
+			return;
+		case op_minus:
+			regs[i] = (0 - a) & p->mask;
+			nans[i] = nans[in->a];
+			return;
+		case op_negate:
+			regs[i] = ~a & p->mask;
+			nans[i] = nans[in->a];
+			return;
+		case op_mul: v = a * b; break;
+		case op_div: if (b == 0) is_nan = 1; else v = a / b; break;
+		case op_mod: if (b == 0) is_nan = 1; else v = a % b; break;
+		case op_add: v = a + b; break;
+		case op_sub: v = a - b; break;
+		case op_shl: v = b < 32 ? a << b : 0; break;
+		case op_shr: v = b < 32 ? a >> b : 0; break;
+		case op_and: v = a & b; break;
+		case op_xor: v = a ^ b; break;
+		case op_or: v = a | b; break;
+		case op_user_0:
+		case op_user_1:
+		case op_user_2:
+			v = op_table_lookup(get_user_operator(in->op - op_user_0), a, b, &is_nan);
+			break;
+		default:
+			break;
+	}
+
+	regs[i] = v & p->mask;
+	nans[i] = nans[in->a] | nans[in->b] | (uint8_t)is_nan;
+}
+
+void gray_run_range(program* p, uint64_t start, uint64_t count, int32_t* values, uint8_t* nan)
+{
+	size_t n = p->variable_count;
+	uint32_t bits = p->bits;
+	uint32_t last = (uint32_t)(p->length - 1);
+	uint32_t* vars;
+	uint32_t* regs;
+	uint8_t* nans;
+	uint32_t* dependents;
+	uint32_t dependent_count;
+	uint64_t step;
+	uint64_t offset;
+	uint64_t index;
+	uint32_t changed_bit;
+	size_t k;
+	uint32_t j;
+
+	if ((count & (count - 1)) != 0 || start % count != 0)
+	{
+		elog(LOG_FATAL_ERROR, "gray_run_range: range %d+%d isn't an aligned power of two\n", (int)start, (int)count);
+	}
+
+	gray_prepare(p);
+
+	vars = (uint32_t*)malloc(sizeof(uint32_t) * (n + p->length));
+	nans = (uint8_t*)malloc(sizeof(uint8_t) * p->length);
+
+	if (vars == 0 || nans == 0)
+	{
+		elog(LOG_FATAL_ERROR, "gray_run_range: out of memory\n");
+	}
+
+	regs = vars + n;
+
+	// the first assignment is evaluated in full
+	for (k=0; k<n; k++)
+	{
+		vars[k] = (uint32_t)((start >> (bits * (n - 1 - k))) & p->mask);
+	}
+
+	for (j=0; j<p->length; j++)
+	{
+		run_instruction(p, j, vars, regs, nans);
+	}
+
+	values[0] = (int32_t)regs[last];
+	nan[0] = nans[last];
+
+	for (step=1; step<count; step++)
+	{
+		// Gray code: the assignment at step differs from the previous one in
+		// the lowest set bit of step only
+		offset = step ^ (step >> 1);
+		index = start + offset;
+		changed_bit = (uint32_t)__builtin_ctzll(step);
+		k = n - 1 - changed_bit / bits;
+
+		vars[k] = (uint32_t)((index >> (bits * (n - 1 - k))) & p->mask);
+
+		dependents = p->gray->dependents[k];
+		dependent_count = p->gray->dependent_count[k];
+
+		for (j=0; j<dependent_count; j++)
+		{
+			run_instruction(p, dependents[j], vars, regs, nans);
+		}
+
+		values[offset] = (int32_t)regs[last];
+		nan[offset] = nans[last];
+	}
+
+	free(nans);
+	free(vars);
+}
+
+void gray_free(gray_plan* plan)
+{
+	size_t k;
+
+	if (plan == 0)
+	{
+		return;
+	}
+
+	for (k=0; k<plan->variable_count; k++)
+	{
+		free(plan->dependents[k]);
+	}
+
+	free(plan->dependents);
+	free(plan->dependent_count);
+	free(plan);
+}
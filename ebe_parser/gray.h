@@ -0,0 +1,41 @@
+#ifndef __GRAY_H__
+#define __GRAY_H__
+
+#include <stdint.h>
+
+#include "program.h"
+
+// Instructions that have to be run again when a variable changes
+typedef struct gray_plan
+{
+	// dependents[k] lists, in program order, every instruction whose value
+	// depends on variable slot k
+	uint32_t** dependents;
+
+	// number of entries in dependents[k]
+	uint32_t* dependent_count;
+
+	// number of variable slots
+	size_t variable_count;
+
+} gray_plan;
+
+// Returns 1 if the program can be evaluated incrementally, otherwise 0.
+int gray_supports(program* p);
+
+// Works out which instructions depend on which variable. The plan is kept
+// with the program (p->gray) and freed by program_free.
+void gray_prepare(program* p);
+
+// Incremental version of program_run_range. The range is visited in Gray
+// code order of the assignment index, so exactly one variable changes from
+// one assignment to the next, and only the instructions depending on that
+// variable are run again. Results are written back to their place in the
+// canonical order. start and count must be powers of two aligned like the
+// chunks handed out by eval_main.
+void gray_run_range(program* p, uint64_t start, uint64_t count, int32_t* values, uint8_t* nan);
+
+// Frees a plan
+void gray_free(gray_plan* plan);
+
+#endif
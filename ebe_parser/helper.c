@@ -2,8 +2,10 @@
 #include <stdlib.h>
 #include <stdio.h>
 
-uint32_t lazy_pow(uint32_t base, uint32_t exp, uint32_t* overflow)
+uint64_t lazy_pow(uint64_t base, uint32_t exp, uint32_t* overflow)
 {
+	*overflow = 0;
+	
 	if (exp == 0)
 	{
 		return 1;
@@ -26,20 +28,19 @@ uint32_t lazy_pow(uint32_t base, uint32_t exp, uint32_t* overflow)
 	
 	uint64_t result = base;
 	
-	*overflow = 0;
-	
-	int i;
+	uint32_t i;
 	for(i=1; i<exp; i++)
 	{
-		result *= base;
-		
-		if (result > UINT32_MAX)
+		if (result > UINT64_MAX / base)
 		{
 			*overflow = 1;
+			return 0;
 		}
+		
+		result *= base;
 	}
 	
-	return (uint32_t)(result & 0xffffffff);
+	return result;
 }
 
 int is_alpha(char c)
@@ -62,10 +63,16 @@ int is_whitespace(char c)
 	return (c == ' ' || c == '\t' || c == '\n' || c == '\r');
 }
 
+int is_user_operator(char c)
+{
+	return (c == '#' || c == '$' || c == '@');
+}
+
 int is_binary_operator(char c)
 {
 	return (c == '+' || c == '-' || c == '*' || c == '/' || c == '%' || 
-		c == '<' || c == '>' || c == '&' || c == '^' || c == '|');
+		c == '<' || c == '>' || c == '&' || c == '^' || c == '|' ||
+		is_user_operator(c));
 }
 
 int is_unary_operator(char c)
@@ -116,6 +123,9 @@ int operator_precendence(char left, char right)
 				case '&': return 1; break;
 				case '^': return 1; break;
 				case '|': return 1; break;
+				case '#': return 1; break;
+				case '$': return 1; break;
+				case '@': return 1; break;
 				default: return -2; break;
 			}
 		break;
@@ -134,6 +144,9 @@ int operator_precendence(char left, char right)
 				case '&': return 1; break;
 				case '^': return 1; break;
 				case '|': return 1; break;
+				case '#': return 1; break;
+				case '$': return 1; break;
+				case '@': return 1; break;
 				default: return -2; break;
 			}
 		break;
@@ -152,6 +165,9 @@ int operator_precendence(char left, char right)
 				case '&': return 1; break;
 				case '^': return 1; break;
 				case '|': return 1; break;
+				case '#': return 1; break;
+				case '$': return 1; break;
+				case '@': return 1; break;
 				default: return -2; break;
 			}
 		break;
@@ -170,6 +186,9 @@ int operator_precendence(char left, char right)
 				case '&': return 1; break;
 				case '^': return 1; break;
 				case '|': return 1; break;
+				case '#': return 1; break;
+				case '$': return 1; break;
+				case '@': return 1; break;
 				default: return -2; break;
 			}
 		break;
@@ -188,6 +207,9 @@ int operator_precendence(char left, char right)
 				case '&': return 1; break;
 				case '^': return 1; break;
 				case '|': return 1; break;
+				case '#': return 1; break;
+				case '$': return 1; break;
+				case '@': return 1; break;
 				default: return -2; break;
 			}
 		break;
@@ -206,6 +228,9 @@ int operator_precendence(char left, char right)
 				case '&': return 1; break;
 				case '^': return 1; break;
 				case '|': return 1; break;
+				case '#': return 1; break;
+				case '$': return 1; break;
+				case '@': return 1; break;
 				default: return -2; break;
 			}
 		break;
@@ -224,6 +249,9 @@ int operator_precendence(char left, char right)
 				case '&': return 1; break;
 				case '^': return 1; break;
 				case '|': return 1; break;
+				case '#': return 1; break;
+				case '$': return 1; break;
+				case '@': return 1; break;
 				default: return -2; break;
 			}
 		break;
@@ -242,6 +270,9 @@ int operator_precendence(char left, char right)
 				case '&': return 1; break;
 				case '^': return 1; break;
 				case '|': return 1; break;
+				case '#': return 1; break;
+				case '$': return 1; break;
+				case '@': return 1; break;
 				default: return -2; break;
 			}
 		break;
@@ -260,6 +291,9 @@ int operator_precendence(char left, char right)
 				case '&': return 1; break;
 				case '^': return 1; break;
 				case '|': return 1; break;
+				case '#': return 1; break;
+				case '$': return 1; break;
+				case '@': return 1; break;
 				default: return -2; break;
 			}
 		break;
@@ -278,6 +312,9 @@ int operator_precendence(char left, char right)
 				case '&': return 0; break;
 				case '^': return 1; break;
 				case '|': return 1; break;
+				case '#': return 1; break;
+				case '$': return 1; break;
+				case '@': return 1; break;
 				default: return -2; break;
 			}
 		break;
@@ -296,6 +333,9 @@ int operator_precendence(char left, char right)
 				case '&': return -1; break;
 				case '^': return 0; break;
 				case '|': return 1; break;
+				case '#': return 1; break;
+				case '$': return 1; break;
+				case '@': return 1; break;
 				default: return -2; break;
 			}
 		break;
@@ -314,6 +354,32 @@ int operator_precendence(char left, char right)
 				case '&': return -1; break;
 				case '^': return -1; break;
 				case '|': return 0; break;
+				case '#': return 1; break;
+				case '$': return 1; break;
+				case '@': return 1; break;
+				default: return -2; break;
+			}
+		break;
+		case '#':
+		case '$':
+		case '@':
+			switch(right)
+			{
+				case '`': return -1; break;
+				case '~': return -1; break;
+				case '*': return -1; break;
+				case '/': return -1; break;
+				case '%': return -1; break;
+				case '+': return -1; break;
+				case '-': return -1; break;
+				case '<': return -1; break;
+				case '>': return -1; break;
+				case '&': return -1; break;
+				case '^': return -1; break;
+				case '|': return -1; break;
+				case '#': return 0; break;
+				case '$': return 0; break;
+				case '@': return 0; break;
 				default: return -2; break;
 			}
 		break;
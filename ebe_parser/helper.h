@@ -23,11 +23,13 @@
 // & bitwise AND
 // ^ bitwise XOR
 // | bitwise OR
+// # $ @ user defined operators (see optable.h), lowest precedence
 
 // lazy exponentiation for integers
 // Multiples base times itself exp times.
-// If the result is larger than can fit in uint32, overflow is set to 1
-uint32_t lazy_pow(uint32_t base, uint32_t exp, uint32_t* overflow);
+// If the result is larger than can fit in uint64, overflow is set to 1
+// and 0 is returned, otherwise overflow is set to 0
+uint64_t lazy_pow(uint64_t base, uint32_t exp, uint32_t* overflow);
 
 // Checks if a character is an alphabetic character or underscore
 // Returns 1 if: a-z or A-Z or _
@@ -49,10 +51,15 @@ int is_alphanumeric(char c);
 int is_whitespace(char c);
 
 // Checks if a character is a binary operator as interpreted by the parser
-// Returns 1 if: */%+-<>&^|
+// Returns 1 if: */%+-<>&^|#$@
 // Otherwise 0
 int is_binary_operator(char c);
 
+// Checks if a character is one of the user defined binary operators
+// Returns 1 if: #$@
+// Otherwise 0
+int is_user_operator(char c);
+
 // Checks if a character is a unary operator as interpreted by the parser
 // Returns 1 if: `-
 // Otherwise 0
@@ -0,0 +1,588 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "jit.h"
+#include "program.h"
+#include "log.h"
+
+#if defined(__x86_64__)
+
+#include <sys/mman.h>
+
+// x86-64 register numbers
+#define RAX 0
+#define RCX 1
+#define RDX 2
+#define RBX 3
+#define RSP 4
+#define RSI 6
+#define RDI 7
+#define R8 8
+#define R9 9
+#define R10 10
+#define R11 11
+#define R12 12
+#define R13 13
+#define R14 14
+#define R15 15
+
+// condition codes for jumps
+#define CC_B 0x2
+#define CC_AE 0x3
+#define CC_NE 0x5
+
+// Registers the first variables are kept in for the whole iteration. Later
+// variables are decoded from the assignment index where they are used.
+#define JIT_VARIABLE_REGISTERS 6
+static const int variable_registers[JIT_VARIABLE_REGISTERS] = { R8, R9, R10, R12, R13, RBX };
+
+// Register use in the generated code:
+//
+// rdi  assignment index
+// rsi  end of the range
+// r14  next entry of values
+// r15  next entry of nan
+// r11d nan flag of the current assignment
+// eax, ecx, edx  scratch; results are computed in eax
+//
+// Registers of the program that are used more than once are stored in a
+// stack slot, [rsp + 4 * register].
+
+// growable buffer the code is generated into
+typedef struct jit_buffer
+{
+	uint8_t* data;
+	size_t length;
+	size_t capacity;
+
+} jit_buffer;
+
+static void emit_byte(jit_buffer* buf, uint8_t b)
+{
+	if (buf->length == buf->capacity)
+	{
+		buf->capacity = buf->capacity * 2 + 256;
+		buf->data = (uint8_t*)realloc(buf->data, buf->capacity);
+
+		if (buf->data == 0)
+		{
+			elog(LOG_FATAL_ERROR, "emit_byte: out of memory\n");
+		}
+	}
+
+	buf->data[buf->length++] = b;
+}
+
+static void emit_u32(jit_buffer* buf, uint32_t v)
+{
+	emit_byte(buf, v & 0xff);
+	emit_byte(buf, (v >> 8) & 0xff);
+	emit_byte(buf, (v >> 16) & 0xff);
+	emit_byte(buf, (v >> 24) & 0xff);
+}
+
+// REX prefix, only emitted when needed
+static void emit_rex(jit_buffer* buf, int w, int reg, int rm)
+{
+	uint8_t rex = 0x40 | (w << 3) | (((reg >> 3) & 1) << 2) | ((rm >> 3) & 1);
+
+	if (rex != 0x40)
+	{
+		emit_byte(buf, rex);
+	}
+}
+
+static uint8_t modrm(int mod, int reg, int rm)
+{
+	return (uint8_t)((mod << 6) | ((reg & 7) << 3) | (rm & 7));
+}
+
+// op r/m, reg with a register operand
+static void emit_rr(jit_buffer* buf, int w, uint8_t opcode, int reg, int rm)
+{
+	emit_rex(buf, w, reg, rm);
+	emit_byte(buf, opcode);
+	emit_byte(buf, modrm(3, reg, rm));
+}
+
+// mov dst32, imm32
+static void emit_mov_imm(jit_buffer* buf, int dst, uint32_t imm)
+{
+	emit_rex(buf, 0, 0, dst);
+	emit_byte(buf, 0xB8 + (dst & 7));
+	emit_u32(buf, imm);
+}
+
+// op dst32, imm32 for the 0x81 group (extension 4 is and)
+static void emit_group1_imm(jit_buffer* buf, int ext, int dst, uint32_t imm)
+{
+	emit_rex(buf, 0, 0, dst);
+	emit_byte(buf, 0x81);
+	emit_byte(buf, modrm(3, ext, dst));
+	emit_u32(buf, imm);
+}
+
+// 0xF7 group on a 32 bit register (2 not, 3 neg, 6 div)
+static void emit_group3(jit_buffer* buf, int ext, int reg)
+{
+	emit_rex(buf, 0, 0, reg);
+	emit_byte(buf, 0xF7);
+	emit_byte(buf, modrm(3, ext, reg));
+}
+
+// mov reg32, [rsp + disp] or mov [rsp + disp], reg32
+static void emit_slot(jit_buffer* buf, uint8_t opcode, int reg, uint32_t slot)
+{
+	emit_rex(buf, 0, reg, RSP);
+	emit_byte(buf, opcode);
+	emit_byte(buf, modrm(2, reg, RSP));
+	emit_byte(buf, 0x24);
+	emit_u32(buf, slot * 4);
+}
+
+static void emit_push(jit_buffer* buf, int reg)
+{
+	emit_rex(buf, 0, 0, reg);
+	emit_byte(buf, 0x50 + (reg & 7));
+}
+
+static void emit_pop(jit_buffer* buf, int reg)
+{
+	emit_rex(buf, 0, 0, reg);
+	emit_byte(buf, 0x58 + (reg & 7));
+}
+
+// short jump with the offset patched later by patch_jump
+static size_t emit_jump8(jit_buffer* buf, int cc)
+{
+	emit_byte(buf, cc < 0 ? 0xEB : 0x70 + cc);
+	emit_byte(buf, 0);
+
+	return buf->length;
+}
+
+// points a short jump to the current position
+static void patch_jump8(jit_buffer* buf, size_t after)
+{
+	buf->data[after - 1] = (uint8_t)(buf->length - after);
+}
+
+// and reg32, mask, unless the mask keeps everything
+static void emit_mask(jit_buffer* buf, int reg, uint32_t mask)
+{
+	if (mask != 0xFFFFFFFF)
+	{
+		emit_group1_imm(buf, 4, reg, mask);
+	}
+}
+
+// decodes the value of a variable from the assignment index into reg
+static void emit_decode_variable(jit_buffer* buf, program* p, uint32_t slot, int reg)
+{
+	uint32_t shift = p->bits * (uint32_t)(p->variable_count - 1 - slot);
+
+	if (shift >= 64)
+	{
+		emit_rr(buf, 0, 0x31, reg, reg);
+		return;
+	}
+
+	// mov reg64, rdi
+	emit_rr(buf, 1, 0x89, RDI, reg);
+
+	if (shift > 0)
+	{
+		// shr reg64, shift
+		emit_rex(buf, 1, 0, reg);
+		emit_byte(buf, 0xC1);
+		emit_byte(buf, modrm(3, 5, reg));
+		emit_byte(buf, (uint8_t)shift);
+	}
+
+	emit_mask(buf, reg, p->mask);
+}
+
+// loads the value of a program register into a machine register
+static void emit_load(jit_buffer* buf, program* p, uint32_t r, int reg)
+{
+	instruction* in = &p->code[r];
+
+	if (in->op == op_const)
+	{
+		emit_mov_imm(buf, reg, in->a);
+	}
+	else if (in->op == op_var && in->a < JIT_VARIABLE_REGISTERS)
+	{
+		emit_rr(buf, 0, 0x89, variable_registers[in->a], reg);
+	}
+	else if (in->op == op_var)
+	{
+		emit_decode_variable(buf, p, in->a, reg);
+	}
+	else
+	{
+		emit_slot(buf, 0x8B, reg, r);
+	}
+}
+
+// Generates the code for the program body. Returns with the result in eax.
+static void emit_body(jit_buffer* buf, program* p, uint8_t* stored)
+{
+	size_t i;
+	int32_t in_eax = -1;
+	instruction* in;
+	size_t j1, j2;
+
+	for (i=0; i<p->length; i++)
+	{
+		in = &p->code[i];
+
+		// constants and variables are loaded where they are used
+		if (in->op == op_const || in->op == op_var)
+		{
+			continue;
+		}
+
+		// left operand in eax, right operand in ecx
+		if (in->op == op_minus || in->op == op_negate)
+		{
+			if (in_eax != (int32_t)in->a)
+			{
+				emit_load(buf, p, in->a, RAX);
+			}
+		}
+		else if (in_eax == (int32_t)in->b && in->a != in->b)
+		{
+			emit_rr(buf, 0, 0x89, RAX, RCX);
+			emit_load(buf, p, in->a, RAX);
+		}
+		else if (in_eax == (int32_t)in->a)
+		{
+			if (in->a == in->b)
+			{
+				emit_rr(buf, 0, 0x89, RAX, RCX);
+			}
+			else
+			{
+				emit_load(buf, p, in->b, RCX);
+			}
+		}
+		else
+		{
+			emit_load(buf, p, in->a, RAX);
+			emit_load(buf, p, in->b, RCX);
+		}
+
+		switch (in->op)
+		{
+			case op_mul:
+				// imul eax, ecx
+				emit_rex(buf, 0, RAX, RCX);
+				emit_byte(buf, 0x0F);
+				emit_byte(buf, 0xAF);
+				emit_byte(buf, modrm(3, RAX, RCX));
+				emit_mask(buf, RAX, p->mask);
+				break;
+			case op_div:
+			case op_mod:
+				// test ecx, ecx; jne divide
+				emit_rr(buf, 0, 0x85, RCX, RCX);
+				j1 = emit_jump8(buf, CC_NE);
+				emit_mov_imm(buf, R11, 1);
+				emit_rr(buf, 0, 0x31, RAX, RAX);
+				j2 = emit_jump8(buf, -1);
+				patch_jump8(buf, j1);
+				emit_rr(buf, 0, 0x31, RDX, RDX);
+				emit_group3(buf, 6, RCX);
+				if (in->op == op_mod)
+				{
+					emit_rr(buf, 0, 0x89, RDX, RAX);
+				}
+				patch_jump8(buf, j2);
+				break;
+			case op_add:
+				emit_rr(buf, 0, 0x01, RCX, RAX);
+				emit_mask(buf, RAX, p->mask);
+				break;
+			case op_sub:
+				emit_rr(buf, 0, 0x29, RCX, RAX);
+				emit_mask(buf, RAX, p->mask);
+				break;
+			case op_shl:
+			case op_shr:
+				// cmp ecx, 32; jae zero
+				emit_rex(buf, 0, 0, RCX);
+				emit_byte(buf, 0x83);
+				emit_byte(buf, modrm(3, 7, RCX));
+				emit_byte(buf, 32);
+				j1 = emit_jump8(buf, CC_AE);
+				// shl/shr eax, cl
+				emit_rex(buf, 0, 0, RAX);
+				emit_byte(buf, 0xD3);
+				emit_byte(buf, modrm(3, in->op == op_shl ? 4 : 5, RAX));
+				j2 = emit_jump8(buf, -1);
+				patch_jump8(buf, j1);
+				emit_rr(buf, 0, 0x31, RAX, RAX);
+				patch_jump8(buf, j2);
+				emit_mask(buf, RAX, p->mask);
+				break;
+			case op_and:
+				emit_rr(buf, 0, 0x21, RCX, RAX);
+				break;
+			case op_xor:
+				emit_rr(buf, 0, 0x31, RCX, RAX);
+				break;
+			case op_or:
+				emit_rr(buf, 0, 0x09, RCX, RAX);
+				break;
+			case op_minus:
+				emit_group3(buf, 3, RAX);
+				emit_mask(buf, RAX, p->mask);
+				break;
+			case op_negate:
+				emit_group3(buf, 2, RAX);
+				emit_mask(buf, RAX, p->mask);
+				break;
+			default:
+				emit_rr(buf, 0, 0x31, RAX, RAX);
+				break;
+		}
+
+		if (stored[i])
+		{
+			emit_slot(buf, 0x89, RAX, (uint32_t)i);
+		}
+
+		in_eax = (int32_t)i;
+	}
+
+	if (in_eax != (int32_t)(p->length - 1))
+	{
+		emit_load(buf, p, (uint32_t)(p->length - 1), RAX);
+	}
+}
+
+// Generates the whole function:
+// void run(uint64_t start, uint64_t count, int32_t* values, uint8_t* nan)
+static void emit_function(jit_buffer* buf, program* p)
+{
+	uint32_t frame;
+	uint8_t* stored;
+	size_t i, k;
+	size_t loop;
+	size_t after;
+	int32_t offset;
+	instruction* in;
+
+	// a register needs a stack slot if it is used anywhere but by the
+	// next instruction, where it is still in eax
+	stored = (uint8_t*)malloc(sizeof(uint8_t) * p->length);
+
+	if (stored == 0)
+	{
+		elog(LOG_FATAL_ERROR, "emit_function: out of memory\n");
+	}
+
+	memset(stored, 0, sizeof(uint8_t) * p->length);
+
+	for (i=0; i<p->length; i++)
+	{
+		in = &p->code[i];
+
+		if (in->op == op_const || in->op == op_var)
+		{
+			continue;
+		}
+
+		if (in->a + 1 != i)
+		{
+			stored[in->a] = 1;
+		}
+
+		if (in->op != op_minus && in->op != op_negate && in->b + 1 != i)
+		{
+			stored[in->b] = 1;
+		}
+	}
+
+	frame = (uint32_t)((p->length * 4 + 15) & ~(size_t)15);
+
+	emit_push(buf, RBX);
+	emit_push(buf, R12);
+	emit_push(buf, R13);
+	emit_push(buf, R14);
+	emit_push(buf, R15);
+
+	// sub rsp, frame
+	emit_rex(buf, 1, 0, RSP);
+	emit_byte(buf, 0x81);
+	emit_byte(buf, modrm(3, 5, RSP));
+	emit_u32(buf, frame);
+
+	// r14 = values, r15 = nan, rsi = start + count
+	emit_rr(buf, 1, 0x89, RDX, R14);
+	emit_rr(buf, 1, 0x89, RCX, R15);
+	emit_rr(buf, 1, 0x01, RDI, RSI);
+
+	// cmp rdi, rsi; jae done (nothing to do)
+	emit_rr(buf, 1, 0x39, RSI, RDI);
+	emit_byte(buf, 0x0F);
+	emit_byte(buf, 0x80 + CC_AE);
+	emit_u32(buf, 0);
+	after = buf->length;
+
+	loop = buf->length;
+
+	// xor r11d, r11d
+	emit_rr(buf, 0, 0x31, R11, R11);
+
+	for (k=0; k<p->variable_count && k<JIT_VARIABLE_REGISTERS; k++)
+	{
+		emit_decode_variable(buf, p, (uint32_t)k, variable_registers[k]);
+	}
+
+	emit_body(buf, p, stored);
+
+	// mov [r14], eax; add r14, 4
+	emit_rex(buf, 0, RAX, R14);
+	emit_byte(buf, 0x89);
+	emit_byte(buf, modrm(0, RAX, R14));
+	emit_rex(buf, 1, 0, R14);
+	emit_byte(buf, 0x83);
+	emit_byte(buf, modrm(3, 0, R14));
+	emit_byte(buf, 4);
+
+	// mov [r15], r11b; inc r15
+	emit_byte(buf, 0x45);
+	emit_byte(buf, 0x88);
+	emit_byte(buf, modrm(0, R11, R15));
+	emit_rex(buf, 1, 0, R15);
+	emit_byte(buf, 0xFF);
+	emit_byte(buf, modrm(3, 0, R15));
+
+	// inc rdi; cmp rdi, rsi; jb loop
+	emit_rex(buf, 1, 0, RDI);
+	emit_byte(buf, 0xFF);
+	emit_byte(buf, modrm(3, 0, RDI));
+	emit_rr(buf, 1, 0x39, RSI, RDI);
+	emit_byte(buf, 0x0F);
+	emit_byte(buf, 0x80 + CC_B);
+	offset = (int32_t)loop - (int32_t)(buf->length + 4);
+	emit_u32(buf, (uint32_t)offset);
+
+	// done:
+	offset = (int32_t)(buf->length - after);
+	memcpy(buf->data + after - 4, &offset, 4);
+
+	// add rsp, frame
+	emit_rex(buf, 1, 0, RSP);
+	emit_byte(buf, 0x81);
+	emit_byte(buf, modrm(3, 0, RSP));
+	emit_u32(buf, frame);
+
+	emit_pop(buf, R15);
+	emit_pop(buf, R14);
+	emit_pop(buf, R13);
+	emit_pop(buf, R12);
+	emit_pop(buf, RBX);
+
+	// ret
+	emit_byte(buf, 0xC3);
+
+	free(stored);
+}
+
+int jit_supports(program* p)
+{
+	return p->bits >= 1 && p->bits <= 32 && !program_uses_user_operators(p);
+}
+
+void jit_prepare(program* p)
+{
+	jit_buffer buf;
+	jit_code* code;
+
+	if (p->jit != 0)
+	{
+		return;
+	}
+
+	memset(&buf, 0, sizeof(jit_buffer));
+
+	emit_function(&buf, p);
+
+	code = (jit_code*)malloc(sizeof(jit_code));
+
+	if (code == 0)
+	{
+		elog(LOG_FATAL_ERROR, "jit_prepare: out of memory\n");
+	}
+
+	code->size = buf.length;
+	code->memory = mmap(0, code->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if (code->memory == MAP_FAILED)
+	{
+		elog(LOG_FATAL_ERROR, "jit_prepare: could not map memory for code\n");
+	}
+
+	memcpy(code->memory, buf.data, buf.length);
+
+	// never writable and executable at the same time
+	if (mprotect(code->memory, code->size, PROT_READ | PROT_EXEC) != 0)
+	{
+		elog(LOG_FATAL_ERROR, "jit_prepare: could not make code executable\n");
+	}
+
+	code->run = (void (*)(uint64_t, uint64_t, int32_t*, uint8_t*))code->memory;
+
+	elog(LOG_VERBOSE, "jit: generated %d bytes of code\n", (int)buf.length);
+
+	free(buf.data);
+
+	p->jit = code;
+}
+
+void jit_run_range(program* p, uint64_t start, uint64_t count, int32_t* values, uint8_t* nan)
+{
+	jit_prepare(p);
+
+	p->jit->run(start, count, values, nan);
+}
+
+void jit_free(jit_code* code)
+{
+	if (code == 0)
+	{
+		return;
+	}
+
+	munmap(code->memory, code->size);
+	free(code);
+}
+
+#else
+
+// only x86-64 code is generated, everything else uses an interpreter
+
+int jit_supports(program* p)
+{
+	return 0;
+}
+
+void jit_prepare(program* p)
+{
+}
+
+void jit_run_range(program* p, uint64_t start, uint64_t count, int32_t* values, uint8_t* nan)
+{
+	program_run_range(p, start, count, values, nan);
+}
+
+void jit_free(jit_code* code)
+{
+}
+
+#endif
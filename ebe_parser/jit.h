@@ -0,0 +1,37 @@
+#ifndef __JIT_H__
+#define __JIT_H__
+
+#include <stdint.h>
+
+#include "program.h"
+
+// Native code compiled for a program
+typedef struct jit_code
+{
+	// executable memory holding the code
+	void* memory;
+
+	// size of the mapping
+	size_t size;
+
+	// entry point, evaluates count assignments beginning at start
+	void (*run)(uint64_t start, uint64_t count, int32_t* values, uint8_t* nan);
+
+} jit_code;
+
+// Returns 1 if native code can be generated for the program on this
+// architecture, otherwise 0.
+int jit_supports(program* p);
+
+// Compiles the program to native code, if it hasn't been already. The code
+// is kept with the program (p->jit) and freed by program_free.
+void jit_prepare(program* p);
+
+// JIT version of program_run_range. The loop over the assignments runs
+// inside the generated code.
+void jit_run_range(program* p, uint64_t start, uint64_t count, int32_t* values, uint8_t* nan);
+
+// Frees native code compiled for a program
+void jit_free(jit_code* code);
+
+#endif
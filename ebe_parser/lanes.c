@@ -0,0 +1,146 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "lanes.h"
+#include "log.h"
+
+// Two SSE2 registers per vector; wider vectors halve the loop overhead
+// without needing a newer instruction set
+#define LANES_VECTOR_BYTES 32
+
+#define LANES_KERNEL_NAME lanes_8
+#define LANES_LANE_TYPE uint8_t
+#include "lanes_kernel.h"
+#undef LANES_KERNEL_NAME
+#undef LANES_LANE_TYPE
+
+#define LANES_KERNEL_NAME lanes_16
+#define LANES_LANE_TYPE uint16_t
+#include "lanes_kernel.h"
+#undef LANES_KERNEL_NAME
+#undef LANES_LANE_TYPE
+
+#define LANES_KERNEL_NAME lanes_32
+#define LANES_LANE_TYPE uint32_t
+#include "lanes_kernel.h"
+#undef LANES_KERNEL_NAME
+#undef LANES_LANE_TYPE
+
+static int is_leaf(op_code op)
+{
+	return op == op_const || op == op_var;
+}
+
+static int is_unary(op_code op)
+{
+	return op == op_minus || op == op_negate;
+}
+
+int lanes_supports(program* p)
+{
+	return p->bits >= 1 && p->variable_count > 0 && !program_uses_user_operators(p) &&
+		p->bits * p->variable_count <= LANES_MAX_INDEX_BITS;
+}
+
+int lanes_same_shape(program* a, program* b)
+{
+	instruction* x;
+	instruction* y;
+	size_t i;
+
+	if (a->length != b->length || a->variable_count != b->variable_count || a->bits != b->bits)
+	{
+		return 0;
+	}
+
+	for (i=0; i<a->length; i++)
+	{
+		x = &a->code[i];
+		y = &b->code[i];
+
+		if (is_leaf(x->op) || is_leaf(y->op))
+		{
+			if (x->op != y->op || x->a != y->a)
+			{
+				return 0;
+			}
+		}
+		else if (is_unary(x->op) != is_unary(y->op) || x->a != y->a ||
+			(!is_unary(x->op) && x->b != y->b))
+		{
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+void lanes_run(program** programs, size_t count, truth_table** tables)
+{
+	program* p = programs[0];
+	uint64_t size = (uint64_t)1 << (p->bits * p->variable_count);
+	uint8_t* uniform;
+	instruction* in;
+	size_t i, k;
+
+	if (count < 1 || count > LANES_MAX)
+	{
+		elog(LOG_FATAL_ERROR, "lanes_run: can't evaluate %d programs\n", (int)count);
+	}
+
+	uniform = (uint8_t*)malloc(sizeof(uint8_t) * p->length);
+
+	if (uniform == 0)
+	{
+		elog(LOG_FATAL_ERROR, "lanes_run: out of memory\n");
+	}
+
+	// A register is uniform when it has the same operator in every program,
+	// and so do all the registers below it. Leaves always are, since the
+	// programs have the same shape.
+	for (i=0; i<p->length; i++)
+	{
+		in = &p->code[i];
+		uniform[i] = 1;
+
+		for (k=1; k<count; k++)
+		{
+			if (programs[k]->code[i].op != in->op)
+			{
+				uniform[i] = 0;
+			}
+		}
+
+		if (is_leaf(in->op))
+		{
+			continue;
+		}
+
+		if (!uniform[in->a] || (!is_unary(in->op) && !uniform[in->b]))
+		{
+			uniform[i] = 0;
+		}
+	}
+
+	for (k=0; k<count; k++)
+	{
+		tables[k] = truth_table_init(size);
+	}
+
+	// the narrowest lanes that hold every value
+	if (p->bits <= 8)
+	{
+		lanes_8(programs, count, uniform, tables);
+	}
+	else if (p->bits <= 16)
+	{
+		lanes_16(programs, count, uniform, tables);
+	}
+	else
+	{
+		lanes_32(programs, count, uniform, tables);
+	}
+
+	free(uniform);
+}
@@ -0,0 +1,39 @@
+#ifndef __LANES_H__
+#define __LANES_H__
+
+#include <stdint.h>
+
+#include "program.h"
+#include "cache.h"
+
+// Largest number of expressions evaluated together, one per vector lane
+#define LANES_MAX 16
+
+// Number of vectors evaluated per register in one pass over the programs
+#define LANES_UNROLL 4
+
+// Smallest group of expressions worth evaluating together
+#define LANES_MIN 2
+
+// Largest assignment space evaluated in lanes, as bits * variables. Every
+// expression of a group gets a whole truth table.
+#define LANES_MAX_INDEX_BITS 20
+
+// Returns 1 if the program can be evaluated in a lane, otherwise 0.
+int lanes_supports(program* p);
+
+// Returns 1 if two programs have the same shape: the same instructions and
+// operands, where only the binary operators, or only the unary operators,
+// may differ. Otherwise 0.
+int lanes_same_shape(program* a, program* b);
+
+// Evaluates count programs of the same shape together, as one program with
+// a lane per expression. Each pass over the shape evaluates a block of
+// assignments for every lane: the variables, and every register whose
+// subtree has the same operators in all lanes, are evaluated once for the
+// group, and only the registers that differ are evaluated per lane, each
+// with its own operator. Returns a new truth table over every assignment
+// for each program.
+void lanes_run(program** programs, size_t count, truth_table** tables);
+
+#endif
@@ -0,0 +1,203 @@
+// Expression lane kernel template, included by lanes.c once per lane width.
+// Before including define:
+//
+// LANES_KERNEL_NAME  name of the kernel function
+// LANES_LANE_TYPE    unsigned integer type of one assignment in a vector
+//
+// The kernel has the signature of lanes_run, plus the uniform flags worked
+// out by lanes_run. A register holds LANES_UNROLL vectors of consecutive
+// assignments for each program, or once for the whole group where the
+// register is uniform.
+
+static void LANES_KERNEL_NAME(program** programs, size_t count, const uint8_t* uniform, truth_table** tables)
+{
+	typedef LANES_LANE_TYPE lane_t;
+	typedef lane_t vec_t __attribute__((vector_size(LANES_VECTOR_BYTES)));
+
+	const size_t lanes = LANES_VECTOR_BYTES / sizeof(lane_t);
+	const uint64_t block_size = lanes * LANES_UNROLL;
+
+	program* p = programs[0];
+	size_t n = p->variable_count;
+	uint32_t bits = p->bits;
+	uint64_t size = (uint64_t)1 << (bits * n);
+
+	// registers of program k at instruction i, see slot()
+	vec_t* regs = 0;
+	vec_t* patterns = 0;
+	vec_t nan_vec[LANES_MAX + 1][LANES_UNROLL];
+
+	const vec_t zero = { 0 };
+	const vec_t one = zero + 1;
+	const vec_t mask = zero + (lane_t)p->mask;
+	const vec_t width = zero + (lane_t)bits;
+	vec_t ok;
+	vec_t divisor;
+
+	vec_t* r;
+	vec_t* a = 0;
+	vec_t* b = 0;
+	vec_t* nan;
+	instruction* in;
+
+	const lane_t* result;
+	const lane_t* lane_nan;
+	const lane_t* group_nan;
+	int32_t* values;
+	uint8_t* nan_out;
+
+	uint64_t block;
+	uint64_t remaining;
+	uint64_t offset;
+	uint32_t shift;
+	size_t i, k, u, lane, first, last;
+
+	if (posix_memalign((void**)&regs, LANES_VECTOR_BYTES, sizeof(vec_t) * LANES_UNROLL * (LANES_MAX + 1) * p->length) != 0 ||
+		posix_memalign((void**)&patterns, LANES_VECTOR_BYTES, sizeof(vec_t) * LANES_UNROLL * n) != 0)
+	{
+		elog(LOG_FATAL_ERROR, "lanes_run: out of memory\n");
+	}
+
+	// Uniform registers live in slot LANES_MAX, the others in the slot of
+	// their program
+	#define slot(reg, k) (regs + ((reg) * (LANES_MAX + 1) + (uniform[reg] ? LANES_MAX : (k))) * LANES_UNROLL)
+
+	// the digit of a variable at offset from an aligned block start, see
+	// simd_kernel.h
+	for (k=0; k<n; k++)
+	{
+		shift = bits * (uint32_t)(n - 1 - k);
+
+		for (u=0; u<LANES_UNROLL; u++)
+		{
+			for (lane=0; lane<lanes; lane++)
+			{
+				offset = u * lanes + lane;
+				patterns[k * LANES_UNROLL + u][lane] = (lane_t)(shift < 64 ? offset >> shift : 0);
+			}
+		}
+	}
+
+	for (block = 0; block < size; block += block_size)
+	{
+		for (k=0; k<=LANES_MAX; k++)
+		{
+			for (u=0; u<LANES_UNROLL; u++)
+			{
+				nan_vec[k][u] = zero;
+			}
+		}
+
+		for (i=0; i<p->length; i++)
+		{
+			// a uniform register is evaluated once, with the first program,
+			// and flags nan for the whole group
+			first = uniform[i] ? LANES_MAX : 0;
+			last = uniform[i] ? LANES_MAX + 1 : count;
+
+			for (k=first; k<last; k++)
+			{
+				in = &programs[k == LANES_MAX ? 0 : k]->code[i];
+				r = slot(i, k);
+				nan = nan_vec[k];
+
+				// the operands of a leaf aren't registers
+				if (in->op != op_const && in->op != op_var)
+				{
+					a = slot(in->a, k);
+					b = in->op == op_minus || in->op == op_negate ? a : slot(in->b, k);
+				}
+
+				switch (in->op)
+				{
+					case op_const:
+						for (u=0; u<LANES_UNROLL; u++) r[u] = zero + (lane_t)in->a;
+						break;
+					case op_var:
+						shift = bits * (uint32_t)(n - 1 - in->a);
+						for (u=0; u<LANES_UNROLL; u++)
+						{
+							r[u] = (patterns[in->a * LANES_UNROLL + u] + (lane_t)(shift < 64 ? block >> shift : 0)) & mask;
+						}
+						break;
+					case op_mul:
+						for (u=0; u<LANES_UNROLL; u++) r[u] = (a[u] * b[u]) & mask;
+						break;
+					case op_div:
+					case op_mod:
+						for (u=0; u<LANES_UNROLL; u++)
+						{
+							// divide by one where the divisor is zero, and flag the lane
+							ok = (vec_t)(b[u] == zero);
+							nan[u] |= ok;
+							divisor = b[u] | (ok & one);
+							r[u] = (in->op == op_div ? a[u] / divisor : a[u] % divisor) & mask;
+						}
+						break;
+					case op_add:
+						for (u=0; u<LANES_UNROLL; u++) r[u] = (a[u] + b[u]) & mask;
+						break;
+					case op_sub:
+						for (u=0; u<LANES_UNROLL; u++) r[u] = (a[u] - b[u]) & mask;
+						break;
+					case op_shl:
+					case op_shr:
+						for (u=0; u<LANES_UNROLL; u++)
+						{
+							// shifting by the width or more clears the lane
+							ok = (vec_t)(b[u] < width);
+							r[u] = (in->op == op_shl ? a[u] << (b[u] & ok) : a[u] >> (b[u] & ok)) & ok & mask;
+						}
+						break;
+					case op_and:
+						for (u=0; u<LANES_UNROLL; u++) r[u] = a[u] & b[u];
+						break;
+					case op_xor:
+						for (u=0; u<LANES_UNROLL; u++) r[u] = a[u] ^ b[u];
+						break;
+					case op_or:
+						for (u=0; u<LANES_UNROLL; u++) r[u] = a[u] | b[u];
+						break;
+					case op_minus:
+						for (u=0; u<LANES_UNROLL; u++) r[u] = (zero - a[u]) & mask;
+						break;
+					case op_negate:
+						for (u=0; u<LANES_UNROLL; u++) r[u] = ~a[u] & mask;
+						break;
+					default:
+						for (u=0; u<LANES_UNROLL; u++) r[u] = zero;
+						break;
+				}
+			}
+		}
+
+		// assignments past the end were evaluated, but aren't copied out
+		remaining = size - block;
+
+		if (remaining > block_size)
+		{
+			remaining = block_size;
+		}
+
+		for (k=0; k<count; k++)
+		{
+			// the vectors of a register are consecutive assignments
+			result = (const lane_t*)slot(p->length - 1, k);
+			lane_nan = (const lane_t*)nan_vec[k];
+			group_nan = (const lane_t*)nan_vec[LANES_MAX];
+			values = tables[k]->values + block;
+			nan_out = tables[k]->nan + block;
+
+			for (offset=0; offset<remaining; offset++)
+			{
+				values[offset] = (int32_t)result[offset];
+				nan_out[offset] = (lane_nan[offset] | group_nan[offset]) != 0;
+			}
+		}
+	}
+
+	#undef slot
+
+	free(patterns);
+	free(regs);
+}
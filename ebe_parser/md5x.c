@@ -0,0 +1,192 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "md5x.h"
+#include "simd.h"
+#include "log.h"
+
+typedef void (*md5x_kernel)(md5x_ctx* ctx, const size_t* blocks, size_t rounds);
+
+// The basic MD5 functions and step, as in md5/md5.c, on vectors
+#define MD5X_F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define MD5X_G(x, y, z) ((y) ^ ((z) & ((x) ^ (y))))
+#define MD5X_H(x, y, z) ((x) ^ (y) ^ (z))
+#define MD5X_I(x, y, z) ((y) ^ ((x) | ~(z)))
+
+#define MD5X_STEP(f, a, b, c, d, x, t, s) \
+	(a) += f((b), (c), (d)) + (x) + (uint32_t)(t); \
+	(a) = ((a) << (s)) | ((a) >> (32 - (s))); \
+	(a) += (b);
+
+// block of a lane with nothing left to compress
+static const unsigned char md5x_zero_block[64] = { 0 };
+
+// Plain vectors, lowered to whatever the cpu has. On x86 these are the SSE2
+// registers every 64 bit cpu has.
+#define MD5X_VECTOR_BYTES 16
+#define MD5X_KERNEL_NAME md5x_generic
+#include "md5x_kernel.h"
+#undef MD5X_KERNEL_NAME
+#undef MD5X_VECTOR_BYTES
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#define MD5X_VECTOR_BYTES 32
+#define MD5X_KERNEL_NAME md5x_avx2
+#include "md5x_kernel.h"
+#undef MD5X_KERNEL_NAME
+#undef MD5X_VECTOR_BYTES
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+#define MD5X_VECTOR_BYTES 64
+#define MD5X_KERNEL_NAME md5x_avx512
+#include "md5x_kernel.h"
+#undef MD5X_KERNEL_NAME
+#undef MD5X_VECTOR_BYTES
+#pragma GCC pop_options
+
+// kernels by instruction set, see simd_level
+static md5x_kernel md5x_kernels[4] = { md5x_generic, md5x_generic, md5x_avx2, md5x_avx512 };
+
+#else
+
+static md5x_kernel md5x_kernels[4] = { md5x_generic, md5x_generic, md5x_generic, md5x_generic };
+
+#endif
+
+// Compresses every whole block buffered, and moves what is left of each
+// message to the start of its buffer
+static void md5x_flush(md5x_ctx* ctx)
+{
+	size_t blocks[MD5X_LANES];
+	size_t rounds = 0;
+	size_t lane;
+
+	for (lane=0; lane<ctx->lanes; lane++)
+	{
+		blocks[lane] = ctx->used[lane] / 64;
+
+		if (blocks[lane] > rounds)
+		{
+			rounds = blocks[lane];
+		}
+	}
+
+	if (rounds == 0)
+	{
+		return;
+	}
+
+	md5x_kernels[simd_detect()](ctx, blocks, rounds);
+
+	for (lane=0; lane<ctx->lanes; lane++)
+	{
+		ctx->used[lane] -= blocks[lane] * 64;
+		memmove(ctx->buffer[lane], ctx->buffer[lane] + blocks[lane] * 64, ctx->used[lane]);
+	}
+}
+
+void md5x_init(md5x_ctx* ctx, size_t lanes)
+{
+	size_t lane;
+
+	if (lanes > MD5X_LANES)
+	{
+		elog(LOG_FATAL_ERROR, "md5x_init: %d messages, at most %d\n", (int)lanes, MD5X_LANES);
+	}
+
+	ctx->lanes = lanes;
+
+	for (lane=0; lane<lanes; lane++)
+	{
+		ctx->a[lane] = 0x67452301;
+		ctx->b[lane] = 0xefcdab89;
+		ctx->c[lane] = 0x98badcfe;
+		ctx->d[lane] = 0x10325476;
+		ctx->length[lane] = 0;
+		ctx->used[lane] = 0;
+	}
+}
+
+void md5x_update(md5x_ctx* ctx, size_t lane, const void* data, size_t size)
+{
+	const unsigned char* ptr = (const unsigned char*)data;
+	size_t n;
+
+	ctx->length[lane] += size;
+
+	while (size > 0)
+	{
+		n = MD5X_BLOCKS * 64 - ctx->used[lane];
+
+		if (n > size)
+		{
+			n = size;
+		}
+
+		memcpy(ctx->buffer[lane] + ctx->used[lane], ptr, n);
+		ctx->used[lane] += n;
+		ptr += n;
+		size -= n;
+
+		if (ctx->used[lane] == MD5X_BLOCKS * 64)
+		{
+			md5x_flush(ctx);
+		}
+	}
+}
+
+void md5x_final(md5x_ctx* ctx, unsigned char results[][16])
+{
+	unsigned char* p;
+	uint64_t bits;
+	size_t lane;
+	size_t used;
+	int i;
+
+	// leaves less than a block in every buffer, so the padding fits
+	md5x_flush(ctx);
+
+	// a 1 bit, zeros up to 8 bytes before the end of a block, and the
+	// length in bits
+	for (lane=0; lane<ctx->lanes; lane++)
+	{
+		p = ctx->buffer[lane];
+		used = ctx->used[lane];
+
+		p[used++] = 0x80;
+
+		while (used % 64 != 56)
+		{
+			p[used++] = 0;
+		}
+
+		bits = ctx->length[lane] << 3;
+
+		for (i=0; i<8; i++)
+		{
+			p[used++] = (unsigned char)(bits >> (8 * i));
+		}
+
+		ctx->used[lane] = used;
+	}
+
+	md5x_flush(ctx);
+
+	for (lane=0; lane<ctx->lanes; lane++)
+	{
+		for (i=0; i<4; i++)
+		{
+			results[lane][i] = (unsigned char)(ctx->a[lane] >> (8 * i));
+			results[lane][4 + i] = (unsigned char)(ctx->b[lane] >> (8 * i));
+			results[lane][8 + i] = (unsigned char)(ctx->c[lane] >> (8 * i));
+			results[lane][12 + i] = (unsigned char)(ctx->d[lane] >> (8 * i));
+		}
+	}
+}
@@ -0,0 +1,53 @@
+#ifndef __MD5X_H__
+#define __MD5X_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Largest number of messages hashed together, one per 32 bit lane of an
+// AVX-512 register
+#define MD5X_LANES 16
+
+// Blocks of 64 bytes buffered per message. Once the buffer of one message
+// is full the buffered blocks of every message are compressed together.
+#define MD5X_BLOCKS 16
+
+// Multi-buffer MD5: hashes up to MD5X_LANES independent messages at once,
+// with a block of each message in a lane of the same vectors (4 lanes with
+// SSE2, 8 with AVX2, 16 with AVX-512). The digest of every message is the
+// one MD5_Final gives for it.
+//
+// Blocks are compressed together when the buffer of one message is full,
+// so messages should be added to in turns of less than a buffer. A message
+// added to much faster than the others has its blocks compressed mostly on
+// their own.
+typedef struct md5x_ctx
+{
+	// number of messages
+	size_t lanes;
+
+	// state of each message
+	uint32_t a[MD5X_LANES];
+	uint32_t b[MD5X_LANES];
+	uint32_t c[MD5X_LANES];
+	uint32_t d[MD5X_LANES];
+
+	// bytes of each message so far
+	uint64_t length[MD5X_LANES];
+
+	// bytes of each message not compressed yet
+	unsigned char buffer[MD5X_LANES][MD5X_BLOCKS * 64];
+	size_t used[MD5X_LANES];
+
+} md5x_ctx;
+
+// Starts a message in each of the first lanes lanes
+void md5x_init(md5x_ctx* ctx, size_t lanes);
+
+// Adds size bytes to the message in lane lane
+void md5x_update(md5x_ctx* ctx, size_t lane, const void* data, size_t size);
+
+// Writes the digest of every message to results, by lane
+void md5x_final(md5x_ctx* ctx, unsigned char results[][16]);
+
+#endif
@@ -0,0 +1,165 @@
+// Multi-buffer MD5 kernel template, included by md5x.c once per instruction
+// set. Before including define:
+//
+// MD5X_KERNEL_NAME   name of the kernel function
+// MD5X_VECTOR_BYTES  size of a vector register in bytes
+//
+// The kernel compresses the first blocks[lane] buffered blocks of every
+// lane, rounds being the largest of them. Lanes are taken a vector at a
+// time, a lane out of blocks keeps its state while the others go on.
+
+static void MD5X_KERNEL_NAME(md5x_ctx* ctx, const size_t* blocks, size_t rounds)
+{
+	typedef uint32_t vec_t __attribute__((vector_size(MD5X_VECTOR_BYTES)));
+
+	const size_t width = MD5X_VECTOR_BYTES / sizeof(uint32_t);
+	const vec_t zero = { 0 };
+
+	vec_t a = zero, b = zero, c = zero, d = zero;
+	vec_t saved_a, saved_b, saved_c, saved_d;
+	vec_t active = zero;
+	vec_t x[16];
+	uint32_t words[16][MD5X_VECTOR_BYTES / sizeof(uint32_t)];
+	const unsigned char* ptr;
+	size_t first, lane, r, i, j;
+	int any;
+
+	for (first=0; first<ctx->lanes; first+=width)
+	{
+		for (j=0; j<width; j++)
+		{
+			lane = first + j;
+
+			a[j] = lane < ctx->lanes ? ctx->a[lane] : 0;
+			b[j] = lane < ctx->lanes ? ctx->b[lane] : 0;
+			c[j] = lane < ctx->lanes ? ctx->c[lane] : 0;
+			d[j] = lane < ctx->lanes ? ctx->d[lane] : 0;
+		}
+
+		for (r=0; r<rounds; r++)
+		{
+			any = 0;
+
+			for (j=0; j<width; j++)
+			{
+				lane = first + j;
+				active[j] = lane < ctx->lanes && r < blocks[lane] ? 0xffffffff : 0;
+				any |= active[j] != 0;
+			}
+
+			if (!any)
+			{
+				break;
+			}
+
+			// word i of the block of every lane goes in x[i]. The words
+			// are gathered in memory and loaded a vector at a time, as
+			// vector elements can't be written one by one cheaply.
+			for (j=0; j<width; j++)
+			{
+				lane = first + j;
+				ptr = active[j] ? ctx->buffer[lane] + r * 64 : md5x_zero_block;
+
+				for (i=0; i<16; i++)
+				{
+					words[i][j] = (uint32_t)ptr[i * 4] | ((uint32_t)ptr[i * 4 + 1] << 8) |
+						((uint32_t)ptr[i * 4 + 2] << 16) | ((uint32_t)ptr[i * 4 + 3] << 24);
+				}
+			}
+
+			for (i=0; i<16; i++)
+			{
+				memcpy(&x[i], words[i], sizeof(vec_t));
+			}
+
+			saved_a = a;
+			saved_b = b;
+			saved_c = c;
+			saved_d = d;
+
+			MD5X_STEP(MD5X_F, a, b, c, d, x[0], 0xd76aa478, 7)
+			MD5X_STEP(MD5X_F, d, a, b, c, x[1], 0xe8c7b756, 12)
+			MD5X_STEP(MD5X_F, c, d, a, b, x[2], 0x242070db, 17)
+			MD5X_STEP(MD5X_F, b, c, d, a, x[3], 0xc1bdceee, 22)
+			MD5X_STEP(MD5X_F, a, b, c, d, x[4], 0xf57c0faf, 7)
+			MD5X_STEP(MD5X_F, d, a, b, c, x[5], 0x4787c62a, 12)
+			MD5X_STEP(MD5X_F, c, d, a, b, x[6], 0xa8304613, 17)
+			MD5X_STEP(MD5X_F, b, c, d, a, x[7], 0xfd469501, 22)
+			MD5X_STEP(MD5X_F, a, b, c, d, x[8], 0x698098d8, 7)
+			MD5X_STEP(MD5X_F, d, a, b, c, x[9], 0x8b44f7af, 12)
+			MD5X_STEP(MD5X_F, c, d, a, b, x[10], 0xffff5bb1, 17)
+			MD5X_STEP(MD5X_F, b, c, d, a, x[11], 0x895cd7be, 22)
+			MD5X_STEP(MD5X_F, a, b, c, d, x[12], 0x6b901122, 7)
+			MD5X_STEP(MD5X_F, d, a, b, c, x[13], 0xfd987193, 12)
+			MD5X_STEP(MD5X_F, c, d, a, b, x[14], 0xa679438e, 17)
+			MD5X_STEP(MD5X_F, b, c, d, a, x[15], 0x49b40821, 22)
+
+			MD5X_STEP(MD5X_G, a, b, c, d, x[1], 0xf61e2562, 5)
+			MD5X_STEP(MD5X_G, d, a, b, c, x[6], 0xc040b340, 9)
+			MD5X_STEP(MD5X_G, c, d, a, b, x[11], 0x265e5a51, 14)
+			MD5X_STEP(MD5X_G, b, c, d, a, x[0], 0xe9b6c7aa, 20)
+			MD5X_STEP(MD5X_G, a, b, c, d, x[5], 0xd62f105d, 5)
+			MD5X_STEP(MD5X_G, d, a, b, c, x[10], 0x02441453, 9)
+			MD5X_STEP(MD5X_G, c, d, a, b, x[15], 0xd8a1e681, 14)
+			MD5X_STEP(MD5X_G, b, c, d, a, x[4], 0xe7d3fbc8, 20)
+			MD5X_STEP(MD5X_G, a, b, c, d, x[9], 0x21e1cde6, 5)
+			MD5X_STEP(MD5X_G, d, a, b, c, x[14], 0xc33707d6, 9)
+			MD5X_STEP(MD5X_G, c, d, a, b, x[3], 0xf4d50d87, 14)
+			MD5X_STEP(MD5X_G, b, c, d, a, x[8], 0x455a14ed, 20)
+			MD5X_STEP(MD5X_G, a, b, c, d, x[13], 0xa9e3e905, 5)
+			MD5X_STEP(MD5X_G, d, a, b, c, x[2], 0xfcefa3f8, 9)
+			MD5X_STEP(MD5X_G, c, d, a, b, x[7], 0x676f02d9, 14)
+			MD5X_STEP(MD5X_G, b, c, d, a, x[12], 0x8d2a4c8a, 20)
+
+			MD5X_STEP(MD5X_H, a, b, c, d, x[5], 0xfffa3942, 4)
+			MD5X_STEP(MD5X_H, d, a, b, c, x[8], 0x8771f681, 11)
+			MD5X_STEP(MD5X_H, c, d, a, b, x[11], 0x6d9d6122, 16)
+			MD5X_STEP(MD5X_H, b, c, d, a, x[14], 0xfde5380c, 23)
+			MD5X_STEP(MD5X_H, a, b, c, d, x[1], 0xa4beea44, 4)
+			MD5X_STEP(MD5X_H, d, a, b, c, x[4], 0x4bdecfa9, 11)
+			MD5X_STEP(MD5X_H, c, d, a, b, x[7], 0xf6bb4b60, 16)
+			MD5X_STEP(MD5X_H, b, c, d, a, x[10], 0xbebfbc70, 23)
+			MD5X_STEP(MD5X_H, a, b, c, d, x[13], 0x289b7ec6, 4)
+			MD5X_STEP(MD5X_H, d, a, b, c, x[0], 0xeaa127fa, 11)
+			MD5X_STEP(MD5X_H, c, d, a, b, x[3], 0xd4ef3085, 16)
+			MD5X_STEP(MD5X_H, b, c, d, a, x[6], 0x04881d05, 23)
+			MD5X_STEP(MD5X_H, a, b, c, d, x[9], 0xd9d4d039, 4)
+			MD5X_STEP(MD5X_H, d, a, b, c, x[12], 0xe6db99e5, 11)
+			MD5X_STEP(MD5X_H, c, d, a, b, x[15], 0x1fa27cf8, 16)
+			MD5X_STEP(MD5X_H, b, c, d, a, x[2], 0xc4ac5665, 23)
+
+			MD5X_STEP(MD5X_I, a, b, c, d, x[0], 0xf4292244, 6)
+			MD5X_STEP(MD5X_I, d, a, b, c, x[7], 0x432aff97, 10)
+			MD5X_STEP(MD5X_I, c, d, a, b, x[14], 0xab9423a7, 15)
+			MD5X_STEP(MD5X_I, b, c, d, a, x[5], 0xfc93a039, 21)
+			MD5X_STEP(MD5X_I, a, b, c, d, x[12], 0x655b59c3, 6)
+			MD5X_STEP(MD5X_I, d, a, b, c, x[3], 0x8f0ccc92, 10)
+			MD5X_STEP(MD5X_I, c, d, a, b, x[10], 0xffeff47d, 15)
+			MD5X_STEP(MD5X_I, b, c, d, a, x[1], 0x85845dd1, 21)
+			MD5X_STEP(MD5X_I, a, b, c, d, x[8], 0x6fa87e4f, 6)
+			MD5X_STEP(MD5X_I, d, a, b, c, x[15], 0xfe2ce6e0, 10)
+			MD5X_STEP(MD5X_I, c, d, a, b, x[6], 0xa3014314, 15)
+			MD5X_STEP(MD5X_I, b, c, d, a, x[13], 0x4e0811a1, 21)
+			MD5X_STEP(MD5X_I, a, b, c, d, x[4], 0xf7537e82, 6)
+			MD5X_STEP(MD5X_I, d, a, b, c, x[11], 0xbd3af235, 10)
+			MD5X_STEP(MD5X_I, c, d, a, b, x[2], 0x2ad7d2bb, 15)
+			MD5X_STEP(MD5X_I, b, c, d, a, x[9], 0xeb86d391, 21)
+
+			// lanes out of blocks keep their state
+			a = saved_a + (a & active);
+			b = saved_b + (b & active);
+			c = saved_c + (c & active);
+			d = saved_d + (d & active);
+		}
+
+		for (j=0; j<width && first + j < ctx->lanes; j++)
+		{
+			lane = first + j;
+
+			ctx->a[lane] = a[j];
+			ctx->b[lane] = b[j];
+			ctx->c[lane] = c[j];
+			ctx->d[lane] = d[j];
+		}
+	}
+}
@@ -0,0 +1,416 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "optable.h"
+#include "program.h"
+#include "helper.h"
+#include "log.h"
+
+// tables of the user defined operators, by index
+static op_table* user_operators[OPTABLE_USER_OPERATORS];
+
+// tables of the built-in operators used by the current program, by op_code
+static op_table* builtin_tables[op_user_0];
+
+static op_table* op_table_alloc(uint32_t bits, size_t length)
+{
+	op_table* t = (op_table*)malloc(sizeof(op_table));
+
+	if (t == 0)
+	{
+		elog(LOG_FATAL_ERROR, "op_table_alloc: out of memory\n");
+	}
+
+	t->bits = bits;
+	t->length = length;
+	t->entries = (uint16_t*)malloc(sizeof(uint16_t) * length);
+
+	if (t->entries == 0)
+	{
+		elog(LOG_FATAL_ERROR, "op_table_alloc: out of memory 2\n");
+	}
+
+	return t;
+}
+
+op_table* op_table_init(op_code op, uint32_t bits)
+{
+	// the operator applied to two variables, run through the interpreter so
+	// the table matches every other engine
+	instruction code[3];
+	program p;
+	int32_t vars[2];
+	int32_t regs[3];
+	int32_t nan;
+	uint32_t size = 1u << bits;
+	uint32_t a, b;
+	uint32_t v;
+	int unary = op == op_minus || op == op_negate;
+	op_table* t;
+
+	if (bits < 1 || bits > OPTABLE_MAX_BITS || op < op_mul || op > op_negate)
+	{
+		elog(LOG_FATAL_ERROR, "op_table_init: can't build table for op %d, bits=%d\n", op, bits);
+	}
+
+	code[0].op = op_var;
+	code[0].a = 0;
+	code[1].op = op_var;
+	code[1].a = 1;
+	code[2].op = op;
+	code[2].a = 0;
+	code[2].b = 1;
+
+	memset(&p, 0, sizeof(program));
+	p.code = code;
+	p.length = 3;
+	p.capacity = 3;
+	p.variable_count = 2;
+	p.bits = bits;
+	p.mask = size - 1;
+
+	t = op_table_alloc(bits, unary ? size : size * size);
+
+	for (a=0; a<size; a++)
+	{
+		for (b=0; b<(unary ? 1 : size); b++)
+		{
+			vars[0] = (int32_t)a;
+			vars[1] = (int32_t)b;
+			nan = 0;
+			v = (uint32_t)program_run(&p, vars, regs, &nan);
+
+			t->entries[unary ? a : (a << bits) | b] = (uint16_t)(v | (nan ? OPTABLE_NAN : 0));
+		}
+	}
+
+	return t;
+}
+
+op_table* op_table_from_bit_map(uint32_t id, uint32_t bits)
+{
+	uint32_t size = 1u << bits;
+	uint32_t a, b;
+	uint32_t i;
+	uint32_t v;
+	op_table* t;
+
+	if (bits < 1 || bits > OPTABLE_MAX_BITS || id > 15)
+	{
+		return 0;
+	}
+
+	t = op_table_alloc(bits, size * size);
+
+	for (a=0; a<size; a++)
+	{
+		for (b=0; b<size; b++)
+		{
+			v = 0;
+
+			for (i=0; i<bits; i++)
+			{
+				v |= ((id >> ((((a >> i) & 1) << 1) | ((b >> i) & 1))) & 1) << i;
+			}
+
+			t->entries[(a << bits) | b] = (uint16_t)v;
+		}
+	}
+
+	return t;
+}
+
+op_table* op_table_from_map(char* map, uint32_t bits)
+{
+	uint32_t size = 1u << bits;
+	size_t i = 0;
+	char* cp = map;
+	char* end;
+	unsigned long v;
+	op_table* t;
+
+	if (bits < 1 || bits > OPTABLE_MAX_BITS)
+	{
+		return 0;
+	}
+
+	t = op_table_alloc(bits, size * size);
+
+	while (*cp != 0)
+	{
+		if (i == t->length)
+		{
+			op_table_free(t);
+			return 0;
+		}
+
+		if (*cp == 'n')
+		{
+			t->entries[i] = OPTABLE_NAN;
+			cp++;
+		}
+		else
+		{
+			v = strtoul(cp, &end, 0);
+
+			if (end == cp || v >= size)
+			{
+				op_table_free(t);
+				return 0;
+			}
+
+			t->entries[i] = (uint16_t)v;
+			cp = end;
+		}
+
+		i++;
+
+		if (*cp == ',')
+		{
+			cp++;
+		}
+		else if (*cp != 0)
+		{
+			op_table_free(t);
+			return 0;
+		}
+	}
+
+	if (i != t->length)
+	{
+		op_table_free(t);
+		return 0;
+	}
+
+	return t;
+}
+
+void op_table_free(op_table* t)
+{
+	if (t == 0)
+	{
+		return;
+	}
+
+	free(t->entries);
+	free(t);
+}
+
+uint32_t op_table_lookup(op_table* t, uint32_t a, uint32_t b, int32_t* nan)
+{
+	uint16_t e = t->entries[(a << t->bits) | b];
+
+	if (e & OPTABLE_NAN)
+	{
+		*nan = 1;
+	}
+
+	return e & (OPTABLE_NAN - 1);
+}
+
+int user_operator_index(char c)
+{
+	switch (c)
+	{
+		case '#': return 0; break;
+		case '$': return 1; break;
+		case '@': return 2; break;
+		default: return -1; break;
+	}
+}
+
+void define_user_operator(char* definition, uint32_t bits)
+{
+	int index = user_operator_index(definition[0]);
+	char* map;
+	char* end;
+	unsigned long id;
+	op_table* t;
+
+	if (index < 0 || definition[1] != '=')
+	{
+		elog(LOG_EXIT_ERROR, "Invalid operator '%s', expected C=ID or C=MAP where C is one of # $ @\n", definition);
+		exit(1);
+	}
+
+	if (bits > OPTABLE_MAX_BITS)
+	{
+		elog(LOG_EXIT_ERROR, "User defined operators need max_bits <= %d\n", OPTABLE_MAX_BITS);
+		exit(1);
+	}
+
+	map = definition + 2;
+
+	if (strchr(map, ',') == 0)
+	{
+		id = strtoul(map, &end, 0);
+		t = end == map || *end != 0 ? 0 : op_table_from_bit_map((uint32_t)id, bits);
+	}
+	else
+	{
+		t = op_table_from_map(map, bits);
+	}
+
+	if (t == 0)
+	{
+		elog(LOG_EXIT_ERROR, "Invalid operator '%s'. ID must be 0-15, MAP must have %d entries below %d (or n)\n",
+			definition, 1 << (2 * bits), 1 << bits);
+		exit(1);
+	}
+
+	op_table_free(user_operators[index]);
+	user_operators[index] = t;
+}
+
+op_table* get_user_operator(int index)
+{
+	if (index < 0 || index >= OPTABLE_USER_OPERATORS)
+	{
+		return 0;
+	}
+
+	return user_operators[index];
+}
+
+void free_user_operators()
+{
+	int i;
+
+	for (i=0; i<OPTABLE_USER_OPERATORS; i++)
+	{
+		op_table_free(user_operators[i]);
+		user_operators[i] = 0;
+	}
+
+	for (i=0; i<op_user_0; i++)
+	{
+		op_table_free(builtin_tables[i]);
+		builtin_tables[i] = 0;
+	}
+}
+
+int optable_supports(program* p)
+{
+	return p->bits >= 1 && p->bits <= OPTABLE_MAX_BITS;
+}
+
+void optable_prepare(program* p)
+{
+	size_t i;
+	op_code op;
+
+	for (i=0; i<p->length; i++)
+	{
+		op = p->code[i].op;
+
+		if (op < op_mul || op > op_negate)
+		{
+			continue;
+		}
+
+		if (builtin_tables[op] != 0 && builtin_tables[op]->bits != p->bits)
+		{
+			op_table_free(builtin_tables[op]);
+			builtin_tables[op] = 0;
+		}
+
+		if (builtin_tables[op] == 0)
+		{
+			builtin_tables[op] = op_table_init(op, p->bits);
+		}
+	}
+}
+
+void optable_run_range(program* p, uint64_t start, uint64_t count, int32_t* values, uint8_t* nan)
+{
+	size_t n = p->variable_count;
+	uint32_t bits = p->bits;
+	uint8_t mask = (uint8_t)p->mask;
+
+	uint8_t* regs;
+	uint8_t nan_block[OPTABLE_BLOCK];
+	uint16_t* entries;
+	uint16_t e;
+
+	uint8_t* r;
+	uint8_t* a;
+	uint8_t* b;
+	instruction* in;
+
+	uint64_t block;
+	uint64_t end = start + count;
+	uint32_t shift;
+	size_t i, j, m;
+
+	if (start % OPTABLE_BLOCK != 0)
+	{
+		elog(LOG_FATAL_ERROR, "optable_run_range: start (%d) is not a multiple of %d\n", (int)start, OPTABLE_BLOCK);
+	}
+
+	regs = (uint8_t*)malloc(sizeof(uint8_t) * OPTABLE_BLOCK * p->length);
+
+	if (regs == 0)
+	{
+		elog(LOG_FATAL_ERROR, "optable_run_range: out of memory\n");
+	}
+
+	for (block = start; block < end; block += OPTABLE_BLOCK)
+	{
+		m = end - block < OPTABLE_BLOCK ? (size_t)(end - block) : OPTABLE_BLOCK;
+
+		memset(nan_block, 0, sizeof(uint8_t) * OPTABLE_BLOCK);
+
+		for (i=0; i<p->length; i++)
+		{
+			in = &p->code[i];
+			r = regs + i * OPTABLE_BLOCK;
+			a = regs + in->a * OPTABLE_BLOCK;
+			b = regs + in->b * OPTABLE_BLOCK;
+
+			switch (in->op)
+			{
+				case op_const:
+					for (j=0; j<m; j++) r[j] = (uint8_t)in->a;
+					break;
+				case op_var:
+					shift = bits * (uint32_t)(n - 1 - in->a);
+					for (j=0; j<m; j++) r[j] = shift < 64 ? (uint8_t)((block + j) >> shift) & mask : 0;
+					break;
+				case op_minus:
+				case op_negate:
+					entries = builtin_tables[in->op]->entries;
+					for (j=0; j<m; j++) r[j] = (uint8_t)entries[a[j]];
+					break;
+				default:
+					if (in->op >= op_user_0)
+					{
+						entries = get_user_operator(in->op - op_user_0)->entries;
+					}
+					else
+					{
+						entries = builtin_tables[in->op]->entries;
+					}
+
+					for (j=0; j<m; j++)
+					{
+						e = entries[((uint32_t)a[j] << bits) | b[j]];
+						r[j] = (uint8_t)e;
+						nan_block[j] |= e >> 8;
+					}
+					break;
+			}
+		}
+
+		r = regs + (p->length - 1) * OPTABLE_BLOCK;
+
+		for (j=0; j<m; j++)
+		{
+			values[block - start + j] = (int32_t)r[j];
+			nan[block - start + j] = nan_block[j];
+		}
+	}
+
+	free(regs);
+}
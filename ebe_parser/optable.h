@@ -0,0 +1,84 @@
+#ifndef __OPTABLE_H__
+#define __OPTABLE_H__
+
+#include <stdint.h>
+
+#include "program.h"
+
+// Largest number of bits per variable operator tables are built for. A
+// binary operator table has 2^bits * 2^bits entries.
+#define OPTABLE_MAX_BITS 8
+
+// Set in a table entry when the result is nan; the value is in the low bits
+#define OPTABLE_NAN 0x100
+
+// Number of user defined operators (#, $, @)
+#define OPTABLE_USER_OPERATORS 3
+
+// Number of assignments evaluated per register in one pass over a program
+#define OPTABLE_BLOCK 256
+
+// Complete description of an operator for one number of bits. Binary
+// operators are indexed by (a << bits) | b, unary operators by a.
+typedef struct op_table
+{
+	uint32_t bits;
+
+	// number of entries
+	size_t length;
+
+	// result of the operator, OPTABLE_NAN added where it is nan
+	uint16_t* entries;
+
+} op_table;
+
+// Builds the table of a built-in operator (op_mul ... op_negate) by running
+// it on every input. Memory is allocated, free with op_table_free.
+op_table* op_table_init(op_code op, uint32_t bits);
+
+// Builds the table of a bitwise operator from the output map of a two input
+// boolean operator, numbered like Operator in the C# project: bit
+// ((a & 1) << 1) | (b & 1) of id is the output for the input bits a and b.
+// The operator is applied to every bit of the values, so id 6 is xor, 8 is
+// and and 14 is or.
+op_table* op_table_from_bit_map(uint32_t id, uint32_t bits);
+
+// Builds a table from an output map: a comma separated list of the
+// 2^bits * 2^bits results, in index order, with n for nan. Returns 0 if the
+// map isn't valid.
+op_table* op_table_from_map(char* map, uint32_t bits);
+
+// Frees a table
+void op_table_free(op_table* t);
+
+// Looks up the result of a binary operator, sets nan to 1 if it is nan.
+uint32_t op_table_lookup(op_table* t, uint32_t a, uint32_t b, int32_t* nan);
+
+// Returns the index of a user defined operator character, or -1.
+int user_operator_index(char c);
+
+// Defines a user operator from the command line, as C=ID or C=MAP where C is
+// one of # $ @, ID the number of a bitwise boolean operator (see
+// op_table_from_bit_map) and MAP a complete output map (see
+// op_table_from_map). Exits with an error if the definition isn't valid.
+void define_user_operator(char* definition, uint32_t bits);
+
+// Returns the table of a user defined operator, or 0 if it isn't defined.
+op_table* get_user_operator(int index);
+
+// Frees the user defined operators
+void free_user_operators();
+
+// Returns 1 if the program can be evaluated by table lookup, otherwise 0.
+int optable_supports(program* p);
+
+// Builds the tables for every operator used by the program. Called once, on
+// the main thread, before the program is run.
+void optable_prepare(program* p);
+
+// Table lookup version of program_run_range. Every operator, including /
+// and %, is a single load from its table, built by optable_prepare. start
+// must be a multiple of OPTABLE_BLOCK.
+void optable_run_range(program* p, uint64_t start, uint64_t count, int32_t* values, uint8_t* nan);
+
+#endif
@@ -0,0 +1,402 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "optimize.h"
+#include "log.h"
+
+// user guide for uthash at
+// http://troydhanson.github.io/uthash/userguide.html
+#include "uthash.h"
+
+// An instruction with its operands already rewritten; two instructions with
+// the same key compute the same value
+typedef struct value_key
+{
+	uint32_t op;
+	uint32_t a;
+	uint32_t b;
+
+} value_key;
+
+typedef struct value_number
+{
+	value_key key;
+
+	// register of the optimized program holding the value
+	uint32_t reg;
+
+	UT_hash_handle hh;
+
+} value_number;
+
+typedef struct optimizer
+{
+	program* p;
+
+	// the optimized instructions. Every instruction of p adds at most one,
+	// so there is room for p->length.
+	instruction* code;
+	size_t length;
+
+	// 1 where the register can't be nan for any assignment
+	uint8_t* nan_free;
+
+	// every instruction of code, by key
+	value_number* values;
+
+	optimize_stats* stats;
+
+} optimizer;
+
+static int is_leaf(op_code op)
+{
+	return op == op_const || op == op_var;
+}
+
+static int is_unary(op_code op)
+{
+	return op == op_minus || op == op_negate;
+}
+
+static int is_commutative(op_code op)
+{
+	return op == op_mul || op == op_add || op == op_and || op == op_xor || op == op_or;
+}
+
+static int is_user(op_code op)
+{
+	return op == op_user_0 || op == op_user_1 || op == op_user_2;
+}
+
+static int is_const(optimizer* o, uint32_t r)
+{
+	return o->code[r].op == op_const;
+}
+
+static int is_value(optimizer* o, uint32_t r, uint32_t value)
+{
+	return o->code[r].op == op_const && o->code[r].a == value;
+}
+
+// 1 if one register is the bitwise negation of the other
+static int is_complement(optimizer* o, uint32_t a, uint32_t b)
+{
+	return (o->code[a].op == op_negate && o->code[a].a == b) ||
+		(o->code[b].op == op_negate && o->code[b].a == a);
+}
+
+// Returns the register computing op on a and b, appending an instruction
+// unless an earlier one computes the same value
+static uint32_t add(optimizer* o, op_code op, uint32_t a, uint32_t b)
+{
+	value_key key;
+	value_number* v;
+	uint32_t r;
+	uint8_t nan_free;
+
+	key.op = (uint32_t)op;
+	key.a = a;
+	key.b = b;
+
+	HASH_FIND(hh, o->values, &key, sizeof(value_key), v);
+
+	if (v != 0)
+	{
+		o->stats->merged++;
+		return v->reg;
+	}
+
+	if (is_leaf(op))
+	{
+		nan_free = 1;
+	}
+	else if (op == op_div || op == op_mod)
+	{
+		nan_free = o->nan_free[a] && is_const(o, b) && o->code[b].a != 0;
+	}
+	else if (is_user(op))
+	{
+		// the map of a user operator may hold nan
+		nan_free = 0;
+	}
+	else
+	{
+		nan_free = o->nan_free[a] && (is_unary(op) || o->nan_free[b]);
+	}
+
+	r = (uint32_t)o->length++;
+
+	o->code[r].op = op;
+	o->code[r].a = a;
+	o->code[r].b = b;
+	o->nan_free[r] = nan_free;
+
+	v = (value_number*)malloc(sizeof(value_number));
+
+	if (v == 0)
+	{
+		elog(LOG_FATAL_ERROR, "program_optimize: out of memory\n");
+	}
+
+	v->key = key;
+	v->reg = r;
+
+	HASH_ADD(hh, o->values, key, sizeof(value_key), v);
+
+	return r;
+}
+
+// Runs op on the constants in registers a and b through the interpreter, so
+// the folded value matches every engine. Returns 0 if the result is nan,
+// which is left for the engine to produce.
+static int fold(optimizer* o, op_code op, uint32_t a, uint32_t b, uint32_t* value)
+{
+	program p = *o->p;
+	instruction code[3];
+	int32_t regs[3];
+	int32_t nan = 0;
+	int32_t v;
+
+	code[0] = o->code[a];
+	code[1] = o->code[b];
+	code[2].op = op;
+	code[2].a = 0;
+	code[2].b = 1;
+
+	p.code = code;
+	p.length = 3;
+	p.capacity = 3;
+	p.jit = 0;
+	p.gray = 0;
+
+	v = program_run(&p, 0, regs, &nan);
+
+	*value = (uint32_t)v;
+
+	return !nan;
+}
+
+// counts an identity and returns the register it gives
+static uint32_t simplified(optimizer* o, uint32_t r)
+{
+	o->stats->simplified++;
+	return r;
+}
+
+// counts an identity giving a constant, and returns its register
+static uint32_t simplified_to(optimizer* o, uint32_t value)
+{
+	o->stats->simplified++;
+	return add(o, op_const, value, 0);
+}
+
+// Returns the register of op on a and b, where a and b are registers of the
+// optimized program
+static uint32_t simplify(optimizer* o, op_code op, uint32_t a, uint32_t b)
+{
+	uint32_t mask = o->p->mask;
+	uint32_t value;
+	uint32_t t;
+
+	if (is_unary(op))
+	{
+		if (is_const(o, a) && fold(o, op, a, a, &value))
+		{
+			o->stats->folded++;
+			return add(o, op_const, value, 0);
+		}
+
+		// ``x and ~~x
+		if (o->code[a].op == op)
+		{
+			return simplified(o, o->code[a].a);
+		}
+
+		return add(o, op, a, 0);
+	}
+
+	// constants on the right, other operands in register order, so a+b and
+	// b+a share a key
+	if (is_commutative(op) && ((is_const(o, a) && !is_const(o, b)) ||
+		(is_const(o, a) == is_const(o, b) && a > b)))
+	{
+		t = a;
+		a = b;
+		b = t;
+	}
+
+	if (is_const(o, a) && is_const(o, b) && fold(o, op, a, b, &value))
+	{
+		o->stats->folded++;
+		return add(o, op_const, value, 0);
+	}
+
+	// Operands are only dropped if they are nan free, otherwise the
+	// instruction stays to flag nan
+	switch (op)
+	{
+		case op_mul:
+			if (is_value(o, b, 1)) return simplified(o, a);
+			if (is_value(o, b, 0) && o->nan_free[a]) return simplified_to(o, 0);
+			break;
+		case op_div:
+			if (is_value(o, b, 1)) return simplified(o, a);
+			break;
+		case op_mod:
+			if (is_value(o, b, 1) && o->nan_free[a]) return simplified_to(o, 0);
+			break;
+		case op_add:
+			if (is_value(o, b, 0)) return simplified(o, a);
+			break;
+		case op_sub:
+			if (is_value(o, b, 0)) return simplified(o, a);
+			if (a == b && o->nan_free[a]) return simplified_to(o, 0);
+			break;
+		case op_shl:
+		case op_shr:
+			if (is_value(o, b, 0)) return simplified(o, a);
+			if (is_value(o, a, 0) && o->nan_free[b]) return simplified_to(o, 0);
+
+			// shifting by the width or more gives zero
+			if (is_const(o, b) && o->code[b].a >= o->p->bits && o->nan_free[a]) return simplified_to(o, 0);
+			break;
+		case op_and:
+			if (is_value(o, b, mask) || a == b) return simplified(o, a);
+			if (is_value(o, b, 0) && o->nan_free[a]) return simplified_to(o, 0);
+			if (is_complement(o, a, b) && o->nan_free[a] && o->nan_free[b]) return simplified_to(o, 0);
+			break;
+		case op_or:
+			if (is_value(o, b, 0) || a == b) return simplified(o, a);
+			if (is_value(o, b, mask) && o->nan_free[a]) return simplified_to(o, mask);
+			if (is_complement(o, a, b) && o->nan_free[a] && o->nan_free[b]) return simplified_to(o, mask);
+			break;
+		case op_xor:
+			if (is_value(o, b, 0)) return simplified(o, a);
+			if (a == b && o->nan_free[a]) return simplified_to(o, 0);
+			if (is_complement(o, a, b) && o->nan_free[a] && o->nan_free[b]) return simplified_to(o, mask);
+			break;
+		default:
+			break;
+	}
+
+	return add(o, op, a, b);
+}
+
+void program_optimize(program* p, optimize_stats* stats)
+{
+	optimizer o;
+	value_number* v;
+	value_number* tmp;
+	instruction* in;
+	uint32_t* map;
+	uint8_t* live;
+	uint32_t result;
+	size_t i;
+	size_t length;
+
+	if (p->jit != 0 || p->gray != 0)
+	{
+		elog(LOG_FATAL_ERROR, "program_optimize: program was already prepared\n");
+	}
+
+	o.p = p;
+	o.length = 0;
+	o.values = 0;
+	o.stats = stats;
+	o.code = (instruction*)malloc(sizeof(instruction) * p->length);
+	o.nan_free = (uint8_t*)malloc(sizeof(uint8_t) * p->length);
+	map = (uint32_t*)calloc(p->length, sizeof(uint32_t));
+
+	if (o.code == 0 || o.nan_free == 0 || map == 0)
+	{
+		elog(LOG_FATAL_ERROR, "program_optimize: out of memory\n");
+	}
+
+	// map holds the optimized register of every register of p
+	for (i=0; i<p->length; i++)
+	{
+		in = &p->code[i];
+
+		if (is_leaf(in->op))
+		{
+			map[i] = add(&o, in->op, in->a, 0);
+		}
+		else
+		{
+			map[i] = simplify(&o, in->op, map[in->a], is_unary(in->op) ? 0 : map[in->b]);
+		}
+	}
+
+	result = map[p->length - 1];
+
+	// Only the instructions below the result are kept. The ones an identity
+	// dropped are nan free, so the result still depends on every
+	// instruction that can be nan.
+	live = o.nan_free;
+
+	for (i=0; i<o.length; i++)
+	{
+		live[i] = i == result;
+	}
+
+	for (i=result + 1; i-- > 0; )
+	{
+		in = &o.code[i];
+
+		if (live[i] && !is_leaf(in->op))
+		{
+			live[in->a] = 1;
+
+			if (!is_unary(in->op))
+			{
+				live[in->b] = 1;
+			}
+		}
+	}
+
+	length = 0;
+
+	for (i=0; i<=result; i++)
+	{
+		if (!live[i])
+		{
+			continue;
+		}
+
+		in = &o.code[i];
+		map[i] = (uint32_t)length;
+		p->code[length] = *in;
+
+		if (!is_leaf(in->op))
+		{
+			p->code[length].a = map[in->a];
+			p->code[length].b = is_unary(in->op) ? 0 : map[in->b];
+		}
+
+		length++;
+	}
+
+	stats->programs++;
+	stats->before += p->length;
+	stats->after += length;
+
+	p->length = length;
+
+	HASH_ITER(hh, o.values, v, tmp)
+	{
+		HASH_DEL(o.values, v);
+		free(v);
+	}
+
+	free(map);
+	free(o.nan_free);
+	free(o.code);
+}
+
+void printf_optimize_stats(optimize_stats* s)
+{
+	elog(LOG_VERBOSE, "optimizer: %llu of %llu instructions removed in %llu programs (%llu folded, %llu simplified, %llu merged)\n",
+		(unsigned long long)(s->before - s->after), (unsigned long long)s->before, (unsigned long long)s->programs,
+		(unsigned long long)s->folded, (unsigned long long)s->simplified, (unsigned long long)s->merged);
+}
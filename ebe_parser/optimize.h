@@ -0,0 +1,44 @@
+#ifndef __OPTIMIZE_H__
+#define __OPTIMIZE_H__
+
+#include <stdint.h>
+
+#include "program.h"
+
+// What an optimization removed. Counts add up over every program optimized
+// with the same stats.
+typedef struct optimize_stats
+{
+	// number of programs optimized
+	uint64_t programs;
+
+	// instructions before and after optimizing
+	uint64_t before;
+	uint64_t after;
+
+	// operators on constants replaced by their value
+	uint64_t folded;
+
+	// operators replaced by an identity, like a-a or x*1
+	uint64_t simplified;
+
+	// instructions merged with an earlier one computing the same value
+	uint64_t merged;
+
+} optimize_stats;
+
+// Optimizes a program in place, before it is prepared by an engine: folds
+// operators on constants, applies identities (a^a, a-a, a|~a, x*1, x&0 and
+// the like), and merges repeated subexpressions so every value is computed
+// once, turning the expression tree into a DAG. Unused instructions are
+// removed.
+//
+// The program produces the same value and nan for every assignment as
+// before. A subtree is only dropped if it can't divide by zero, so x&0
+// stays as it is when x holds a / or %.
+void program_optimize(program* p, optimize_stats* stats);
+
+// Prints optimize_stats, LOG_VERBOSE
+void printf_optimize_stats(optimize_stats* s);
+
+#endif
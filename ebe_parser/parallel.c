@@ -0,0 +1,218 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "parallel.h"
+#include "log.h"
+
+// one buffer of the ring
+typedef struct parallel_slot
+{
+	int32_t* values;
+	uint8_t* nan;
+
+	// 1 once a worker has evaluated the chunk in the slot
+	int ready;
+
+} parallel_slot;
+
+// state shared by the workers and the calling thread
+typedef struct parallel_job
+{
+	engine* eng;
+	program* p;
+	uint64_t start;
+	uint64_t end;
+	uint64_t chunk_count;
+
+	parallel_slot* slots;
+	size_t slot_count;
+
+	// next chunk a worker takes, counted from start
+	uint64_t next_chunk;
+
+	// number of chunks handed to emit; chunk c can only go into its slot
+	// once chunk c - slot_count has been emitted
+	uint64_t emitted;
+
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+
+} parallel_job;
+
+static uint64_t chunk_start(parallel_job* job, uint64_t chunk)
+{
+	return job->start + chunk * EVAL_CHUNK_SIZE;
+}
+
+static uint64_t chunk_length(parallel_job* job, uint64_t chunk)
+{
+	uint64_t start = chunk_start(job, chunk);
+
+	return job->end - start < EVAL_CHUNK_SIZE ? job->end - start : EVAL_CHUNK_SIZE;
+}
+
+static void* worker(void* arg)
+{
+	parallel_job* job = (parallel_job*)arg;
+	parallel_slot* slot;
+	uint64_t chunk;
+
+	pthread_mutex_lock(&job->lock);
+
+	while (job->next_chunk < job->chunk_count)
+	{
+		chunk = job->next_chunk;
+
+		if (chunk >= job->emitted + job->slot_count)
+		{
+			pthread_cond_wait(&job->changed, &job->lock);
+			continue;
+		}
+
+		job->next_chunk++;
+		pthread_mutex_unlock(&job->lock);
+
+		slot = &job->slots[chunk % job->slot_count];
+		job->eng->run_range(job->p, chunk_start(job, chunk), chunk_length(job, chunk), slot->values, slot->nan);
+
+		pthread_mutex_lock(&job->lock);
+		slot->ready = 1;
+		pthread_cond_broadcast(&job->changed);
+	}
+
+	pthread_mutex_unlock(&job->lock);
+
+	return 0;
+}
+
+static void run_serial(engine* eng, program* p, uint64_t first, uint64_t end, chunk_callback emit, void* context)
+{
+	int32_t* values = (int32_t*)malloc(sizeof(int32_t) * EVAL_CHUNK_SIZE);
+	uint8_t* nan = (uint8_t*)malloc(sizeof(uint8_t) * EVAL_CHUNK_SIZE);
+	uint64_t start;
+	uint64_t count;
+
+	if (values == 0 || nan == 0)
+	{
+		elog(LOG_FATAL_ERROR, "parallel_run: out of memory\n");
+	}
+
+	for (start = first; start < end; start += count)
+	{
+		count = end - start < EVAL_CHUNK_SIZE ? end - start : EVAL_CHUNK_SIZE;
+
+		eng->run_range(p, start, count, values, nan);
+		emit(context, start, count, values, nan);
+	}
+
+	free(values);
+	free(nan);
+}
+
+void parallel_run(engine* eng, program* p, uint64_t start, uint64_t end, int threads, chunk_callback emit, void* context)
+{
+	parallel_job job;
+	parallel_slot* slot;
+	pthread_t* workers;
+	uint64_t chunk;
+	size_t i;
+
+	if (start % EVAL_CHUNK_SIZE != 0)
+	{
+		elog(LOG_FATAL_ERROR, "parallel_run: start (%llu) is not a multiple of %d\n", (unsigned long long)start, EVAL_CHUNK_SIZE);
+	}
+
+	job.chunk_count = (end - start + EVAL_CHUNK_SIZE - 1) / EVAL_CHUNK_SIZE;
+
+	// threads past the number of chunks would have nothing to do
+	if (job.chunk_count < (uint64_t)threads)
+	{
+		threads = (int)job.chunk_count;
+	}
+
+	if (threads <= 1)
+	{
+		run_serial(eng, p, start, end, emit, context);
+		return;
+	}
+
+	job.eng = eng;
+	job.p = p;
+	job.start = start;
+	job.end = end;
+	job.next_chunk = 0;
+	job.emitted = 0;
+	job.slot_count = (size_t)threads * PARALLEL_SLOTS_PER_THREAD;
+	job.slots = (parallel_slot*)malloc(sizeof(parallel_slot) * job.slot_count);
+	workers = (pthread_t*)malloc(sizeof(pthread_t) * threads);
+
+	if (job.slots == 0 || workers == 0)
+	{
+		elog(LOG_FATAL_ERROR, "parallel_run: out of memory\n");
+	}
+
+	for (i=0; i<job.slot_count; i++)
+	{
+		job.slots[i].values = (int32_t*)malloc(sizeof(int32_t) * EVAL_CHUNK_SIZE);
+		job.slots[i].nan = (uint8_t*)malloc(sizeof(uint8_t) * EVAL_CHUNK_SIZE);
+		job.slots[i].ready = 0;
+
+		if (job.slots[i].values == 0 || job.slots[i].nan == 0)
+		{
+			elog(LOG_FATAL_ERROR, "parallel_run: out of memory 2\n");
+		}
+	}
+
+	pthread_mutex_init(&job.lock, 0);
+	pthread_cond_init(&job.changed, 0);
+
+	for (i=0; i<(size_t)threads; i++)
+	{
+		if (pthread_create(&workers[i], 0, worker, &job) != 0)
+		{
+			elog(LOG_FATAL_ERROR, "parallel_run: can't start thread %d\n", (int)i);
+		}
+	}
+
+	for (chunk = 0; chunk < job.chunk_count; chunk++)
+	{
+		slot = &job.slots[chunk % job.slot_count];
+
+		pthread_mutex_lock(&job.lock);
+
+		while (!slot->ready)
+		{
+			pthread_cond_wait(&job.changed, &job.lock);
+		}
+
+		pthread_mutex_unlock(&job.lock);
+
+		// no worker touches the slot until it is marked emitted
+		emit(context, chunk_start(&job, chunk), chunk_length(&job, chunk), slot->values, slot->nan);
+
+		pthread_mutex_lock(&job.lock);
+		slot->ready = 0;
+		job.emitted++;
+		pthread_cond_broadcast(&job.changed);
+		pthread_mutex_unlock(&job.lock);
+	}
+
+	for (i=0; i<(size_t)threads; i++)
+	{
+		pthread_join(workers[i], 0);
+	}
+
+	pthread_cond_destroy(&job.changed);
+	pthread_mutex_destroy(&job.lock);
+
+	for (i=0; i<job.slot_count; i++)
+	{
+		free(job.slots[i].values);
+		free(job.slots[i].nan);
+	}
+
+	free(job.slots);
+	free(workers);
+}
@@ -0,0 +1,29 @@
+#ifndef __PARALLEL_H__
+#define __PARALLEL_H__
+
+#include <stdint.h>
+
+#include "program.h"
+#include "engine.h"
+
+// Number of evaluated chunks each thread may run ahead of the caller
+#define PARALLEL_SLOTS_PER_THREAD 4
+
+// Largest number of threads for -j
+#define PARALLEL_MAX_THREADS 256
+
+// Called with the values of each chunk of assignments, in order
+typedef void (*chunk_callback)(void* context, uint64_t start, uint64_t count, int32_t* values, uint8_t* nan);
+
+// Evaluates assignments start to end-1 of a program with an engine, in
+// chunks of EVAL_CHUNK_SIZE, and hands every chunk to emit. start must be a
+// multiple of EVAL_CHUNK_SIZE. With more than one thread the chunks are
+// evaluated by worker threads into a ring of buffers, but emit still runs
+// on the calling thread and sees the chunks in increasing order, so its
+// output doesn't depend on the number of threads.
+//
+// The engine must be prepared for the program beforehand. Workers only
+// read the program and the engine.
+void parallel_run(engine* eng, program* p, uint64_t start, uint64_t end, int threads, chunk_callback emit, void* context);
+
+#endif
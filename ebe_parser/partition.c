@@ -0,0 +1,137 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "partition.h"
+
+static uint64_t completions(partition* p, uint32_t left, uint32_t blocks)
+{
+	return p->completions[left * (p->n + 1) + blocks];
+}
+
+void partition_init(partition* p, uint32_t n)
+{
+	uint32_t left;
+	uint32_t blocks;
+	uint64_t same;
+	uint64_t count;
+
+	p->n = n;
+	p->rgs = (uint32_t*)calloc(n + 1, sizeof(uint32_t));
+	p->max = (uint32_t*)calloc(n + 1, sizeof(uint32_t));
+	p->completions = (uint64_t*)calloc((size_t)(n + 1) * (n + 1), sizeof(uint64_t));
+
+	if (p->rgs == 0 || p->max == 0 || p->completions == 0)
+	{
+		printf("partition_init: out of memory\n");
+		exit(1);
+	}
+
+	// The recurrence of the Stirling numbers of the second kind: the next
+	// element joins one of the blocks there are, or starts a new one. Only
+	// the entries a string can reach, with no more blocks than elements,
+	// are filled in, and each is at most bell(n).
+	for (left = 0; left < n; left++)
+	{
+		for (blocks = 1; blocks + left <= n; blocks++)
+		{
+			if (left == 0)
+			{
+				count = 1;
+			}
+			else
+			{
+				same = completions(p, left - 1, blocks);
+				count = same * blocks + completions(p, left - 1, blocks + 1);
+
+				if (same > UINT64_MAX / blocks || count < same * blocks)
+				{
+					printf("too many combinations, bell(%d) doesn't fit in 64 bits\n", n);
+					exit(1);
+				}
+			}
+
+			p->completions[left * (n + 1) + blocks] = count;
+		}
+	}
+}
+
+uint64_t partition_bell(partition* p, uint32_t m)
+{
+	// the first element is in block 0
+	return m == 0 ? 1 : completions(p, m - 1, 1);
+}
+
+void partition_unrank(partition* p, uint64_t rank)
+{
+	uint32_t blocks = 1;
+	uint64_t count;
+	uint64_t block;
+	uint32_t k;
+
+	if (p->n == 0)
+	{
+		return;
+	}
+
+	p->rgs[0] = 0;
+	p->max[0] = 0;
+
+	for (k=1; k<p->n; k++)
+	{
+		// each block there is leads to the same number of strings, a new
+		// block comes last
+		count = completions(p, p->n - 1 - k, blocks);
+		block = rank / count;
+
+		if (block > blocks)
+		{
+			block = blocks;
+		}
+
+		rank -= block * count;
+
+		p->rgs[k] = (uint32_t)block;
+		p->max[k] = p->max[k - 1] > block ? p->max[k - 1] : (uint32_t)block;
+		blocks = p->max[k] + 1;
+	}
+}
+
+int partition_next(partition* p)
+{
+	uint32_t k = p->n;
+	uint32_t j;
+
+	// the last element that can move to a later block does, and the ones
+	// after it go back to block 0
+	while (k-- > 1)
+	{
+		if (p->rgs[k] <= p->max[k - 1])
+		{
+			p->rgs[k]++;
+			p->max[k] = p->max[k - 1] > p->rgs[k] ? p->max[k - 1] : p->rgs[k];
+
+			for (j=k+1; j<p->n; j++)
+			{
+				p->rgs[j] = 0;
+				p->max[j] = p->max[k];
+			}
+
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+void partition_free(partition* p)
+{
+	free(p->rgs);
+	free(p->max);
+	free(p->completions);
+
+	p->rgs = 0;
+	p->max = 0;
+	p->completions = 0;
+}
@@ -0,0 +1,47 @@
+#ifndef __PARTITION_H__
+#define __PARTITION_H__
+
+#include <stdint.h>
+
+// Set partitions of n elements as restricted growth strings: element k is
+// in block rgs[k], rgs[0] is 0, and every rgs[k] is at most one more than
+// the largest block before it. Partitions are visited in increasing order
+// of their strings, https://oeis.org/A193023 row n,
+//
+//   000, 001, 010, 011, 012
+//
+// and there are bell(n) of them.
+typedef struct partition
+{
+	// number of elements
+	uint32_t n;
+
+	// block of each element
+	uint32_t* rgs;
+
+	// largest block among the elements up to and including each one
+	uint32_t* max;
+
+	// completions[left * (n+1) + blocks] is the number of ways to finish a
+	// string with left elements to go and blocks blocks used
+	uint64_t* completions;
+
+} partition;
+
+// Sets up the tables and buffers for partitions of n elements, and starts
+// at the first one. Exits if bell(n) doesn't fit in 64 bits.
+void partition_init(partition* p, uint32_t n);
+
+// Number of partitions of m elements, bell(m), for m up to n
+uint64_t partition_bell(partition* p, uint32_t m);
+
+// Moves to the partition of rank rank, less than bell(n), in O(n)
+void partition_unrank(partition* p, uint64_t rank);
+
+// Moves to the next partition, in O(1) amortized. Returns 0, and stays, at
+// the last one.
+int partition_next(partition* p);
+
+void partition_free(partition* p);
+
+#endif
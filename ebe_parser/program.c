@@ -0,0 +1,447 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "program.h"
+#include "jit.h"
+#include "gray.h"
+#include "optable.h"
+#include "expression.h"
+#include "linked_list.h"
+#include "helper.h"
+#include "log.h"
+
+// initial number of instructions allocated for a program
+#define PROGRAM_CHUNK_SIZE 32
+
+program* program_init(uint32_t bits)
+{
+	program* p = (program*)malloc(sizeof(program));
+
+	if (p == 0)
+	{
+		elog(LOG_FATAL_ERROR, "program_init: out of memory\n");
+	}
+
+	p->length = 0;
+	p->capacity = PROGRAM_CHUNK_SIZE;
+	p->variable_count = 0;
+	p->bits = bits;
+	p->mask = (uint32_t)((1ULL << bits) - 1);
+	p->jit = 0;
+	p->gray = 0;
+
+	p->code = (instruction*)malloc(sizeof(instruction) * p->capacity);
+
+	if (p->code == 0)
+	{
+		elog(LOG_FATAL_ERROR, "program_init: out of memory 2\n");
+	}
+
+	return p;
+}
+
+uint32_t program_emit(program* p, op_code op, uint32_t a, uint32_t b)
+{
+	if (p->length == p->capacity)
+	{
+		p->capacity = p->capacity + PROGRAM_CHUNK_SIZE;
+
+		p->code = (instruction*)realloc(p->code, sizeof(instruction) * p->capacity);
+
+		if (p->code == 0)
+		{
+			elog(LOG_FATAL_ERROR, "program_emit: out of memory\n");
+		}
+	}
+
+	p->code[p->length].op = op;
+	p->code[p->length].a = a;
+	p->code[p->length].b = b;
+
+	p->length++;
+
+	return (uint32_t)(p->length - 1);
+}
+
+// finds the slot of a variable by comparing the (consolidated) name pointer
+static uint32_t find_variable_slot(linked_list* variables, char** name)
+{
+	linked_list_node* node = variables->head;
+
+	while (node)
+	{
+		if (node->var_name == name)
+		{
+			return (uint32_t)(node->id - 1);
+		}
+
+		node = node->next;
+	}
+
+	elog(LOG_FATAL_ERROR, "Error, can't find symbol '%s' in variable list\n", *name);
+	return 0;
+}
+
+// converts a binary operator character into an op_code
+static op_code binary_op_code(char c)
+{
+	switch (c)
+	{
+		case '*': return op_mul; break;
+		case '/': return op_div; break;
+		case '%': return op_mod; break;
+		case '+': return op_add; break;
+		case '-': return op_sub; break;
+		case '<': return op_shl; break;
+		case '>': return op_shr; break;
+		case '&': return op_and; break;
+		case '^': return op_xor; break;
+		case '|': return op_or; break;
+		case '#':
+		case '$':
+		case '@':
+			if (get_user_operator(user_operator_index(c)) == 0)
+			{
+				elog(LOG_EXIT_ERROR, "Operator '%c' is used but not defined (see --operator)\n", c);
+				exit(1);
+			}
+			return (op_code)(op_user_0 + user_operator_index(c));
+			break;
+		default:
+			elog(LOG_FATAL_ERROR, "Attempting to compile unknown operator.\n");
+			break;
+	}
+
+	return op_const;
+}
+
+// Recursive helper to compile an expression tree. This follows eval() in
+// eval.c node for node; returns the register holding the node value.
+static uint32_t compile_recursive(program* p, expression_node* e, linked_list* variables)
+{
+	char* sym_value;
+	uint32_t r = 0;
+	uint32_t left;
+
+	if (e == 0)
+	{
+		felog_d(LOG_NORMAL, "Warning! compiling empty node.\n");
+		return program_emit(p, op_const, 0, 0);
+	}
+
+	if (e->sym == 0 && e->left == 0)
+	{
+		felog_d(LOG_NORMAL, "Warning! compiling node with empty symbol.\n");
+		return program_emit(p, op_const, 0, 0);
+	}
+	else if (e->sym == 0 && e->left != 0)
+	{
+		r = compile_recursive(p, e->left, variables);
+
+		if (e->unary_minus)
+		{
+			return program_emit(p, op_minus, r, 0);
+		}
+		else if (e->unary_bitwise_negate)
+		{
+			return program_emit(p, op_negate, r, 0);
+		}
+
+		return r;
+	}
+
+	sym_value = *(e->sym->value);
+
+	switch (e->sym->symbol_type)
+	{
+		case tk_term:
+			if (strlen(sym_value) >= 2 && sym_value[0] == '0' && (sym_value[1] == 'x' || sym_value[1] == 'X'))
+			{
+				r = program_emit(p, op_const, (uint32_t)strtoul(sym_value, 0, 16) & p->mask, 0);
+			}
+			else if (is_alpha(sym_value[0]))
+			{
+				r = program_emit(p, op_var, find_variable_slot(variables, e->sym->value), 0);
+			}
+			else
+			{
+				r = program_emit(p, op_const, (uint32_t)strtoul(sym_value, 0, 10) & p->mask, 0);
+			}
+			break;
+
+		case tk_operator:
+			if (is_binary_operator(sym_value[0]))
+			{
+				left = compile_recursive(p, e->left, variables);
+				r = compile_recursive(p, e->right, variables);
+				r = program_emit(p, binary_op_code(sym_value[0]), left, r);
+			}
+			else
+			{
+				// a unary operator symbol on its own evaluates to zero
+				r = program_emit(p, op_const, 0, 0);
+
+				if (sym_value[0] == '`')
+				{
+					r = program_emit(p, op_minus, r, 0);
+				}
+				else if (sym_value[0] == '~')
+				{
+					r = program_emit(p, op_negate, r, 0);
+				}
+			}
+			break;
+
+		default:
+			elog(LOG_FATAL_ERROR, "Attempting to compile unknown token.\n");
+			break;
+	}
+
+	if (e->unary_minus)
+	{
+		r = program_emit(p, op_minus, r, 0);
+	}
+	if (e->unary_bitwise_negate)
+	{
+		r = program_emit(p, op_negate, r, 0);
+	}
+
+	return r;
+}
+
+program* program_compile(expression_node* e, linked_list* variables, uint32_t bits)
+{
+	program* p = program_init(bits);
+
+	p->variable_count = variables->length;
+
+	compile_recursive(p, e, variables);
+
+	return p;
+}
+
+int32_t program_run(program* p, const int32_t* vars, int32_t* regs, int32_t* nan)
+{
+	const instruction* code = p->code;
+	const instruction* end = p->code + p->length;
+	uint32_t mask = p->mask;
+	uint32_t* r = (uint32_t*)regs;
+	uint32_t v;
+
+	for (; code < end; code++, r++)
+	{
+		switch (code->op)
+		{
+			case op_const:
+				v = code->a;
+				break;
+			case op_var:
+				v = (uint32_t)vars[code->a];
+				break;
+			case op_mul:
+				v = (uint32_t)regs[code->a] * (uint32_t)regs[code->b];
+				break;
+			case op_div:
+				v = (uint32_t)regs[code->b];
+				if (v == 0)
+				{
+					*nan = 1;
+				}
+				else
+				{
+					v = (uint32_t)regs[code->a] / v;
+				}
+				break;
+			case op_mod:
+				v = (uint32_t)regs[code->b];
+				if (v == 0)
+				{
+					*nan = 1;
+				}
+				else
+				{
+					v = (uint32_t)regs[code->a] % v;
+				}
+				break;
+			case op_add:
+				v = (uint32_t)regs[code->a] + (uint32_t)regs[code->b];
+				break;
+			case op_sub:
+				v = (uint32_t)regs[code->a] - (uint32_t)regs[code->b];
+				break;
+			case op_shl:
+				v = (uint32_t)regs[code->b];
+				v = v < 32 ? (uint32_t)regs[code->a] << v : 0;
+				break;
+			case op_shr:
+				v = (uint32_t)regs[code->b];
+				v = v < 32 ? (uint32_t)regs[code->a] >> v : 0;
+				break;
+			case op_and:
+				v = (uint32_t)regs[code->a] & (uint32_t)regs[code->b];
+				break;
+			case op_xor:
+				v = (uint32_t)regs[code->a] ^ (uint32_t)regs[code->b];
+				break;
+			case op_or:
+				v = (uint32_t)regs[code->a] | (uint32_t)regs[code->b];
+				break;
+			case op_minus:
+				v = 0 - (uint32_t)regs[code->a];
+				break;
+			case op_negate:
+				v = ~(uint32_t)regs[code->a];
+				break;
+			case op_user_0:
+			case op_user_1:
+			case op_user_2:
+				v = op_table_lookup(get_user_operator(code->op - op_user_0), (uint32_t)regs[code->a], (uint32_t)regs[code->b], nan);
+				break;
+			default:
+				v = 0;
+				break;
+		}
+
+		*r = v & mask;
+	}
+
+	return regs[p->length - 1];
+}
+
+void program_run_range(program* p, uint64_t start, uint64_t count, int32_t* values, uint8_t* nan)
+{
+	size_t n = p->variable_count;
+	int32_t* vars = (int32_t*)malloc(sizeof(int32_t) * (n + p->length));
+	int32_t* regs;
+	int32_t is_nan;
+	uint64_t i;
+	size_t k;
+
+	if (vars == 0)
+	{
+		elog(LOG_FATAL_ERROR, "program_run_range: out of memory\n");
+	}
+
+	regs = vars + n;
+
+	// decode the starting assignment, then count up odometer style
+	for (k=0; k<n; k++)
+	{
+		vars[k] = (int32_t)((start >> (p->bits * (n - 1 - k))) & p->mask);
+	}
+
+	for (i=0; i<count; i++)
+	{
+		is_nan = 0;
+		values[i] = program_run(p, vars, regs, &is_nan);
+		nan[i] = (uint8_t)is_nan;
+
+		k = n;
+		while (k > 0)
+		{
+			k--;
+
+			if ((uint32_t)vars[k] < p->mask)
+			{
+				vars[k]++;
+				break;
+			}
+
+			vars[k] = 0;
+		}
+	}
+
+	free(vars);
+}
+
+int program_uses_user_operators(program* p)
+{
+	size_t i;
+
+	for (i=0; i<p->length; i++)
+	{
+		if (p->code[i].op >= op_user_0 && p->code[i].op <= op_user_2)
+		{
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+void program_free(program* p)
+{
+	if (p == 0)
+	{
+		return;
+	}
+
+	if (p->code != 0)
+	{
+		free(p->code);
+		p->code = 0;
+	}
+
+	jit_free(p->jit);
+	p->jit = 0;
+
+	gray_free(p->gray);
+	p->gray = 0;
+
+	free(p);
+}
+
+// Converts op code into a string for output
+static char* op_code_to_string(op_code op)
+{
+	switch (op)
+	{
+		case op_const: return "const"; break;
+		case op_var: return "var"; break;
+		case op_mul: return "*"; break;
+		case op_div: return "/"; break;
+		case op_mod: return "%"; break;
+		case op_add: return "+"; break;
+		case op_sub: return "-"; break;
+		case op_shl: return "<<"; break;
+		case op_shr: return ">>"; break;
+		case op_and: return "&"; break;
+		case op_xor: return "^"; break;
+		case op_or: return "|"; break;
+		case op_minus: return "`"; break;
+		case op_negate: return "~"; break;
+		case op_user_0: return "#"; break;
+		case op_user_1: return "$"; break;
+		case op_user_2: return "@"; break;
+		default:
+			return "unknown"; break;
+	}
+}
+
+void printf_program(program* p)
+{
+	size_t i;
+	instruction* in;
+
+	for (i=0; i<p->length; i++)
+	{
+		in = &p->code[i];
+
+		switch (in->op)
+		{
+			case op_const:
+			case op_var:
+				elog(LOG_VERBOSE, "r%d = %s %d\n", (int)i, op_code_to_string(in->op), in->a);
+				break;
+			case op_minus:
+			case op_negate:
+				elog(LOG_VERBOSE, "r%d = %s r%d\n", (int)i, op_code_to_string(in->op), in->a);
+				break;
+			default:
+				elog(LOG_VERBOSE, "r%d = r%d %s r%d\n", (int)i, in->a, op_code_to_string(in->op), in->b);
+				break;
+		}
+	}
+}
@@ -0,0 +1,123 @@
+#ifndef __PROGRAM_H__
+#define __PROGRAM_H__
+
+#include <stdint.h>
+
+#include "expression.h"
+#include "linked_list.h"
+
+// Operations understood by a compiled program. The binary operators are
+// the same as the ones accepted by the parser (see helper.h).
+typedef enum op_code
+{
+	op_const,
+	op_var,
+
+	op_mul,
+	op_div,
+	op_mod,
+	op_add,
+	op_sub,
+	op_shl,
+	op_shr,
+	op_and,
+	op_xor,
+	op_or,
+
+	// unary minus (`)
+	op_minus,
+
+	// unary bitwise not (~)
+	op_negate,
+
+	// user defined binary operators (#, $, @), see optable.h
+	op_user_0,
+	op_user_1,
+	op_user_2
+
+} op_code;
+
+// A single instruction. Every instruction writes its result to the register
+// with the same index as the instruction, and operands always refer to
+// registers of earlier instructions.
+typedef struct instruction
+{
+	op_code op;
+
+	// op_const: the (masked) constant value
+	// op_var: the variable slot
+	// otherwise: register of the left (or only) operand
+	uint32_t a;
+
+	// register of the right operand, binary operators only
+	uint32_t b;
+
+} instruction;
+
+// Flat register program lowered from an expression tree. Constants are
+// decoded and variables are resolved to integer slots at compile time,
+// so running the program never touches the hash or any strings.
+// The result of the program is the value of the last register.
+typedef struct program
+{
+	instruction* code;
+
+	// number of instructions (and registers)
+	size_t length;
+
+	// number of instructions allocated
+	size_t capacity;
+
+	// number of variable slots; slot i belongs to the variable with id i+1
+	size_t variable_count;
+
+	// number of bits in every variable
+	uint32_t bits;
+
+	// mask applied to the result of every operation
+	uint32_t mask;
+
+	// native code generated for the program, or 0. See jit.h
+	struct jit_code* jit;
+
+	// dependencies for incremental evaluation, or 0. See gray.h
+	struct gray_plan* gray;
+
+} program;
+
+// Compiles an expression tree into a program. Variable names must already
+// be consolidated so that every leaf for a variable shares the var_name
+// pointer of its node in the variables list. Memory is allocated, and should
+// be freed with program_free.
+program* program_compile(expression_node* e, linked_list* variables, uint32_t bits);
+
+// Mallocs a new empty program, for instructions added with program_emit.
+// variable_count is left at 0 for the caller to set.
+program* program_init(uint32_t bits);
+
+// Appends an instruction to the end of the program, resizing if necessary.
+// Returns the register the instruction writes to.
+uint32_t program_emit(program* p, op_code op, uint32_t a, uint32_t b);
+
+// Runs a program for one assignment of variable values. regs must have room
+// for p->length values. If a divide or modulus by zero occurs nan is set to 1.
+int32_t program_run(program* p, const int32_t* vars, int32_t* regs, int32_t* nan);
+
+// Runs a program for count consecutive assignments, starting at assignment
+// index start. The assignment index holds the value of every variable in
+// p->bits sized digits, the last variable in the lowest digit (the order the
+// assignments are enumerated in eval_main). values and nan receive one entry
+// per assignment.
+void program_run_range(program* p, uint64_t start, uint64_t count, int32_t* values, uint8_t* nan);
+
+// Returns 1 if the program uses a user defined operator, otherwise 0. Only
+// engines evaluating through lookup tables support these.
+int program_uses_user_operators(program* p);
+
+// Frees a program and its instructions
+void program_free(program* p);
+
+// Prints the instructions of a program, LOG_VERBOSE
+void printf_program(program* p);
+
+#endif
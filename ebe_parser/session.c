@@ -0,0 +1,443 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "session.h"
+#include "program.h"
+#include "optable.h"
+#include "log.h"
+
+eval_session* session_init(size_t cache_bytes)
+{
+	eval_session* s = (eval_session*)malloc(sizeof(eval_session));
+
+	if (s == 0)
+	{
+		elog(LOG_FATAL_ERROR, "session_init: out of memory\n");
+	}
+
+	memset(s, 0, sizeof(eval_session));
+
+	if (cache_bytes > 0)
+	{
+		s->cache = table_cache_init(cache_bytes);
+	}
+
+	return s;
+}
+
+// number of assignments of a program, 0 if it is too many to keep
+static uint64_t table_size(program* p)
+{
+	uint64_t bits = (uint64_t)p->bits * p->variable_count;
+
+	if (bits >= 63 || (1ULL << bits) > SESSION_MAX_ASSIGNMENTS)
+	{
+		return 0;
+	}
+
+	return 1ULL << bits;
+}
+
+int session_supports(program* p)
+{
+	return p->bits >= 1 && p->bits <= 32 && table_size(p) != 0;
+}
+
+static uint64_t mix_splitmix(uint64_t x)
+{
+	x += 0x9E3779B97F4A7C15ULL;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+	return x ^ (x >> 31);
+}
+
+static uint64_t mix_murmur(uint64_t x)
+{
+	x ^= x >> 33;
+	x *= 0xFF51AFD7ED558CCDULL;
+	x ^= x >> 33;
+	x *= 0xC4CEB9FE1A85EC53ULL;
+	return x ^ (x >> 33);
+}
+
+static int is_unary(op_code op)
+{
+	return op == op_minus || op == op_negate;
+}
+
+static int is_leaf(op_code op)
+{
+	return op == op_const || op == op_var;
+}
+
+// computes the truth table of one register from the tables of its operands
+static void compute_table(program* p, uint32_t i, truth_table** tables, uint64_t size)
+{
+	instruction* in = &p->code[i];
+	uint32_t* r = (uint32_t*)tables[i]->values;
+	uint8_t* rn = tables[i]->nan;
+	uint32_t* a = is_leaf(in->op) ? 0 : (uint32_t*)tables[in->a]->values;
+	uint32_t* b = is_leaf(in->op) || is_unary(in->op) ? 0 : (uint32_t*)tables[in->b]->values;
+	uint8_t* an = is_leaf(in->op) ? 0 : tables[in->a]->nan;
+	uint8_t* bn = b == 0 ? 0 : tables[in->b]->nan;
+	uint32_t mask = p->mask;
+	uint32_t shift;
+	uint64_t x;
+	int32_t is_nan;
+	op_table* t;
+
+	switch (in->op)
+	{
+		case op_const:
+			for (x=0; x<size; x++) r[x] = in->a;
+			memset(rn, 0, sizeof(uint8_t) * size);
+			return;
+		case op_var:
+			shift = p->bits * (uint32_t)(p->variable_count - 1 - in->a);
+			for (x=0; x<size; x++) r[x] = (uint32_t)(x >> shift) & mask;
+			memset(rn, 0, sizeof(uint8_t) * size);
+			return;
+		case op_minus:
+			for (x=0; x<size; x++) r[x] = (0 - a[x]) & mask;
+			memcpy(rn, an, sizeof(uint8_t) * size);
+			return;
+		case op_negate:
+			for (x=0; x<size; x++) r[x] = ~a[x] & mask;
+			memcpy(rn, an, sizeof(uint8_t) * size);
+			return;
+		default:
+			break;
+	}
+
+	for (x=0; x<size; x++)
+	{
+		rn[x] = an[x] | bn[x];
+	}
+
+	switch (in->op)
+	{
+		case op_mul:
+			for (x=0; x<size; x++) r[x] = (a[x] * b[x]) & mask;
+			break;
+		case op_div:
+			for (x=0; x<size; x++)
+			{
+				rn[x] |= b[x] == 0;
+				r[x] = b[x] == 0 ? 0 : a[x] / b[x];
+			}
+			break;
+		case op_mod:
+			for (x=0; x<size; x++)
+			{
+				rn[x] |= b[x] == 0;
+				r[x] = b[x] == 0 ? 0 : a[x] % b[x];
+			}
+			break;
+		case op_add:
+			for (x=0; x<size; x++) r[x] = (a[x] + b[x]) & mask;
+			break;
+		case op_sub:
+			for (x=0; x<size; x++) r[x] = (a[x] - b[x]) & mask;
+			break;
+		case op_shl:
+			for (x=0; x<size; x++) r[x] = b[x] < 32 ? (a[x] << b[x]) & mask : 0;
+			break;
+		case op_shr:
+			for (x=0; x<size; x++) r[x] = b[x] < 32 ? a[x] >> b[x] : 0;
+			break;
+		case op_and:
+			for (x=0; x<size; x++) r[x] = a[x] & b[x];
+			break;
+		case op_xor:
+			for (x=0; x<size; x++) r[x] = a[x] ^ b[x];
+			break;
+		case op_or:
+			for (x=0; x<size; x++) r[x] = a[x] | b[x];
+			break;
+		case op_user_0:
+		case op_user_1:
+		case op_user_2:
+			t = get_user_operator(in->op - op_user_0);
+			for (x=0; x<size; x++)
+			{
+				is_nan = 0;
+				r[x] = op_table_lookup(t, a[x], b[x], &is_nan);
+				rn[x] |= (uint8_t)is_nan;
+			}
+			break;
+		default:
+			memset(r, 0, sizeof(uint32_t) * size);
+			break;
+	}
+}
+
+// Matches every register of p with the register in the same position of
+// the previous program, and returns for each the previous register whose
+// table is the same, or -1.
+static int64_t* match_previous(eval_session* s, program* p)
+{
+	program* q = s->previous;
+	int64_t* same = (int64_t*)malloc(sizeof(int64_t) * p->length);
+	int64_t j;
+	size_t i;
+	instruction* in;
+	instruction* old;
+
+	if (same == 0)
+	{
+		elog(LOG_FATAL_ERROR, "match_previous: out of memory\n");
+	}
+
+	for (i=0; i<p->length; i++)
+	{
+		same[i] = -1;
+	}
+
+	if (q == 0 || q->variable_count != p->variable_count || q->bits != p->bits)
+	{
+		return same;
+	}
+
+	// Position first, top down from the root: children of matched nodes
+	// are matched by side. Operands always come before the instruction, so
+	// walking the program backwards visits parents first.
+	same[p->length - 1] = (int64_t)(q->length - 1);
+
+	i = p->length;
+	while (i > 0)
+	{
+		i--;
+		j = same[i];
+
+		if (j < 0)
+		{
+			continue;
+		}
+
+		in = &p->code[i];
+		old = &q->code[j];
+
+		if (!is_leaf(in->op) && !is_leaf(old->op))
+		{
+			same[in->a] = old->a;
+
+			if (!is_unary(in->op) && !is_unary(old->op))
+			{
+				same[in->b] = old->b;
+			}
+		}
+	}
+
+	// Then contents, bottom up: a node keeps its match only if it is the
+	// same operation on matching children.
+	for (i=0; i<p->length; i++)
+	{
+		j = same[i];
+
+		if (j < 0)
+		{
+			continue;
+		}
+
+		in = &p->code[i];
+		old = &q->code[j];
+
+		if (in->op != old->op ||
+			(is_leaf(in->op) && in->a != old->a) ||
+			(!is_leaf(in->op) && same[in->a] != (int64_t)old->a) ||
+			(!is_leaf(in->op) && !is_unary(in->op) && same[in->b] != (int64_t)old->b))
+		{
+			same[i] = -1;
+		}
+	}
+
+	return same;
+}
+
+// Structural hash of every register of p: the operation, its constant or
+// variable slot, and the hashes of its operands. The number of bits and
+// variables are hashed into the leaves, since they change the tables.
+static cache_key* structural_keys(program* p)
+{
+	cache_key* keys = (cache_key*)malloc(sizeof(cache_key) * p->length);
+	instruction* in;
+	uint64_t a1, a2, b1, b2;
+	size_t i;
+
+	if (keys == 0)
+	{
+		elog(LOG_FATAL_ERROR, "structural_keys: out of memory\n");
+	}
+
+	for (i=0; i<p->length; i++)
+	{
+		in = &p->code[i];
+
+		if (is_leaf(in->op))
+		{
+			a1 = a2 = in->a;
+			b1 = b2 = ((uint64_t)p->bits << 32) | p->variable_count;
+		}
+		else
+		{
+			a1 = keys[in->a].h1;
+			a2 = keys[in->a].h2;
+			b1 = is_unary(in->op) ? 0 : keys[in->b].h1;
+			b2 = is_unary(in->op) ? 0 : keys[in->b].h2;
+		}
+
+		keys[i].h1 = mix_splitmix(mix_splitmix(mix_splitmix(0x5eed0001ULL + in->op) ^ a1) ^ b1);
+		keys[i].h2 = mix_murmur(mix_murmur(mix_murmur(0x5eed0002ULL + in->op) + a2) + b2 * 3);
+	}
+
+	return keys;
+}
+
+static void free_tables(eval_session* s)
+{
+	size_t i;
+
+	if (s->previous == 0)
+	{
+		return;
+	}
+
+	for (i=0; i<s->previous->length; i++)
+	{
+		truth_table_release(s->tables[i]);
+	}
+
+	free(s->tables);
+	program_free(s->previous);
+
+	s->tables = 0;
+	s->previous = 0;
+}
+
+void session_run(eval_session* s, program* p, int32_t** values, uint8_t** nan)
+{
+	uint64_t size = table_size(p);
+	int64_t* same;
+	cache_key* keys = 0;
+	truth_table** tables;
+	truth_table* t;
+	uint8_t* need;
+	instruction* in;
+	size_t i;
+
+	if (!session_supports(p))
+	{
+		elog(LOG_FATAL_ERROR, "session_run: assignment space too large for a session\n");
+	}
+
+	same = match_previous(s, p);
+
+	if (s->cache != 0)
+	{
+		keys = structural_keys(p);
+	}
+
+	tables = (truth_table**)malloc(sizeof(truth_table*) * p->length);
+	need = (uint8_t*)malloc(sizeof(uint8_t) * p->length);
+
+	if (tables == 0 || need == 0)
+	{
+		elog(LOG_FATAL_ERROR, "session_run: out of memory\n");
+	}
+
+	memset(tables, 0, sizeof(truth_table*) * p->length);
+	memset(need, 0, sizeof(uint8_t) * p->length);
+
+	// Top down from the root: a node whose table is found doesn't need its
+	// children. need is set to 2 for the nodes that have to be computed.
+	need[p->length - 1] = 1;
+
+	i = p->length;
+	while (i > 0)
+	{
+		i--;
+
+		if (need[i] == 0)
+		{
+			continue;
+		}
+
+		in = &p->code[i];
+
+		if (same[i] >= 0 && s->tables[same[i]] != 0)
+		{
+			tables[i] = s->tables[same[i]];
+			truth_table_ref(tables[i]);
+			s->reused++;
+			continue;
+		}
+
+		if (keys != 0 && !is_leaf(in->op))
+		{
+			t = table_cache_find(s->cache, &keys[i]);
+
+			if (t != 0)
+			{
+				tables[i] = t;
+				truth_table_ref(t);
+				continue;
+			}
+		}
+
+		need[i] = 2;
+
+		if (!is_leaf(in->op))
+		{
+			need[in->a] = 1;
+
+			if (!is_unary(in->op))
+			{
+				need[in->b] = 1;
+			}
+		}
+	}
+
+	// then compute bottom up, every operand is available by now
+	for (i=0; i<p->length; i++)
+	{
+		if (need[i] != 2)
+		{
+			continue;
+		}
+
+		tables[i] = truth_table_init(size);
+		compute_table(p, (uint32_t)i, tables, size);
+		s->computed++;
+
+		if (keys != 0 && !is_leaf(p->code[i].op))
+		{
+			table_cache_add(s->cache, &keys[i], tables[i], size);
+		}
+	}
+
+	free(need);
+	free(keys);
+	free(same);
+	free_tables(s);
+
+	s->previous = p;
+	s->tables = tables;
+	s->size = size;
+
+	*values = tables[p->length - 1]->values;
+	*nan = tables[p->length - 1]->nan;
+}
+
+void session_free(eval_session* s)
+{
+	if (s == 0)
+	{
+		return;
+	}
+
+	free_tables(s);
+	table_cache_free(s->cache);
+	free(s);
+}
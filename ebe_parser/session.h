@@ -0,0 +1,58 @@
+#ifndef __SESSION_H__
+#define __SESSION_H__
+
+#include <stdint.h>
+
+#include "program.h"
+#include "cache.h"
+
+// Largest assignment space kept as truth tables between expressions
+#define SESSION_MAX_ASSIGNMENTS (1 << 22)
+
+// Evaluation session for a sequence of expressions. The truth table of
+// every node of the last expression is kept, and the next expression takes
+// over the tables of the nodes it shares with it. Tables of subtrees seen
+// further back come from the cache.
+typedef struct eval_session
+{
+	// program of the last expression, or 0
+	program* previous;
+
+	// truth table of every register of previous, 0 where it wasn't needed
+	truth_table** tables;
+
+	// number of assignments in every table
+	uint64_t size;
+
+	// subtree cache, or 0 for none
+	table_cache* cache;
+
+	// number of tables taken over from the previous expression, and
+	// computed, over the life of the session
+	uint64_t reused;
+	uint64_t computed;
+
+} eval_session;
+
+// Mallocs a new session, with a subtree cache of up to cache_bytes
+// (0 for no cache)
+eval_session* session_init(size_t cache_bytes);
+
+// Returns 1 if a session can evaluate the program, otherwise 0.
+int session_supports(program* p);
+
+// Evaluates every assignment of a program. A node is matched against the
+// node in the same position of the previous expression; if the two
+// subtrees are identical its table is taken over. Otherwise its table is
+// looked up in the cache by the structural hash of the subtree, and
+// failing that computed from the tables of its children, which are found
+// the same way. When one leaf or operator changes only the tables on the
+// path to the root are computed.
+// The session takes ownership of the program. values and nan are set to the
+// tables of the result, which stay valid until the next call.
+void session_run(eval_session* s, program* p, int32_t** values, uint8_t** nan);
+
+// Frees a session, its cache, its tables and the last program
+void session_free(eval_session* s);
+
+#endif
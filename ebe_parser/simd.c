@@ -0,0 +1,210 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "simd.h"
+#include "program.h"
+#include "log.h"
+
+typedef void (*simd_kernel)(program* p, uint64_t start, uint64_t count, int32_t* values, uint8_t* nan);
+
+#if defined(__x86_64__) || defined(__i386__)
+
+// Kernels are instantiated from simd_kernel.h per instruction set and lane
+// width. Each instruction set is enabled only for its own kernels, the cpu is
+// checked before any of them is called.
+
+#pragma GCC push_options
+#pragma GCC target("sse2")
+
+#define SIMD_VECTOR_BYTES 16
+
+#define SIMD_KERNEL_NAME simd_sse2_8
+#define SIMD_LANE_TYPE uint8_t
+#include "simd_kernel.h"
+#undef SIMD_KERNEL_NAME
+#undef SIMD_LANE_TYPE
+
+#define SIMD_KERNEL_NAME simd_sse2_16
+#define SIMD_LANE_TYPE uint16_t
+#include "simd_kernel.h"
+#undef SIMD_KERNEL_NAME
+#undef SIMD_LANE_TYPE
+
+#define SIMD_KERNEL_NAME simd_sse2_32
+#define SIMD_LANE_TYPE uint32_t
+#include "simd_kernel.h"
+#undef SIMD_KERNEL_NAME
+#undef SIMD_LANE_TYPE
+
+#undef SIMD_VECTOR_BYTES
+
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+#define SIMD_VECTOR_BYTES 32
+
+#define SIMD_KERNEL_NAME simd_avx2_8
+#define SIMD_LANE_TYPE uint8_t
+#include "simd_kernel.h"
+#undef SIMD_KERNEL_NAME
+#undef SIMD_LANE_TYPE
+
+#define SIMD_KERNEL_NAME simd_avx2_16
+#define SIMD_LANE_TYPE uint16_t
+#include "simd_kernel.h"
+#undef SIMD_KERNEL_NAME
+#undef SIMD_LANE_TYPE
+
+#define SIMD_KERNEL_NAME simd_avx2_32
+#define SIMD_LANE_TYPE uint32_t
+#include "simd_kernel.h"
+#undef SIMD_KERNEL_NAME
+#undef SIMD_LANE_TYPE
+
+#undef SIMD_VECTOR_BYTES
+
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx512bw")
+
+#define SIMD_VECTOR_BYTES 64
+
+#define SIMD_KERNEL_NAME simd_avx512_8
+#define SIMD_LANE_TYPE uint8_t
+#include "simd_kernel.h"
+#undef SIMD_KERNEL_NAME
+#undef SIMD_LANE_TYPE
+
+#define SIMD_KERNEL_NAME simd_avx512_16
+#define SIMD_LANE_TYPE uint16_t
+#include "simd_kernel.h"
+#undef SIMD_KERNEL_NAME
+#undef SIMD_LANE_TYPE
+
+#define SIMD_KERNEL_NAME simd_avx512_32
+#define SIMD_LANE_TYPE uint32_t
+#include "simd_kernel.h"
+#undef SIMD_KERNEL_NAME
+#undef SIMD_LANE_TYPE
+
+#undef SIMD_VECTOR_BYTES
+
+#pragma GCC pop_options
+
+// kernels by instruction set, then lane width (8, 16, 32 bits)
+static simd_kernel simd_kernels[4][3] =
+{
+	{ program_run_range, program_run_range, program_run_range },
+	{ simd_sse2_8, simd_sse2_16, simd_sse2_32 },
+	{ simd_avx2_8, simd_avx2_16, simd_avx2_32 },
+	{ simd_avx512_8, simd_avx512_16, simd_avx512_32 }
+};
+
+// the cpu is checked once, the first run_range calls may come from several
+// worker threads at the same time
+static pthread_once_t simd_detect_once = PTHREAD_ONCE_INIT;
+static simd_level simd_detected = simd_scalar;
+
+static void simd_detect_cpu()
+{
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+	{
+		simd_detected = simd_avx512;
+	}
+	else if (__builtin_cpu_supports("avx2"))
+	{
+		simd_detected = simd_avx2;
+	}
+	else if (__builtin_cpu_supports("sse2"))
+	{
+		simd_detected = simd_sse2;
+	}
+}
+
+simd_level simd_detect()
+{
+	pthread_once(&simd_detect_once, simd_detect_cpu);
+
+	return simd_detected;
+}
+
+#else
+
+// no kernels on other architectures, everything runs on the scalar program
+static simd_kernel simd_kernels[4][3] =
+{
+	{ program_run_range, program_run_range, program_run_range },
+	{ program_run_range, program_run_range, program_run_range },
+	{ program_run_range, program_run_range, program_run_range },
+	{ program_run_range, program_run_range, program_run_range }
+};
+
+simd_level simd_detect()
+{
+	return simd_scalar;
+}
+
+#endif
+
+// picks the narrowest lane that holds a value
+static simd_kernel find_kernel(simd_level level, program* p)
+{
+	if (p->bits <= 8)
+	{
+		return simd_kernels[level][0];
+	}
+	else if (p->bits <= 16)
+	{
+		return simd_kernels[level][1];
+	}
+
+	return simd_kernels[level][2];
+}
+
+int simd_supports(program* p)
+{
+	return p->bits >= 1 && p->bits <= 32 && !program_uses_user_operators(p);
+}
+
+void simd_run_range(program* p, uint64_t start, uint64_t count, int32_t* values, uint8_t* nan)
+{
+	find_kernel(simd_detect(), p)(p, start, count, values, nan);
+}
+
+int simd_sse2_supports(program* p)
+{
+	return simd_supports(p) && simd_detect() >= simd_sse2;
+}
+
+void simd_sse2_run_range(program* p, uint64_t start, uint64_t count, int32_t* values, uint8_t* nan)
+{
+	find_kernel(simd_sse2, p)(p, start, count, values, nan);
+}
+
+int simd_avx2_supports(program* p)
+{
+	return simd_supports(p) && simd_detect() >= simd_avx2;
+}
+
+void simd_avx2_run_range(program* p, uint64_t start, uint64_t count, int32_t* values, uint8_t* nan)
+{
+	find_kernel(simd_avx2, p)(p, start, count, values, nan);
+}
+
+int simd_avx512_supports(program* p)
+{
+	return simd_supports(p) && simd_detect() >= simd_avx512;
+}
+
+void simd_avx512_run_range(program* p, uint64_t start, uint64_t count, int32_t* values, uint8_t* nan)
+{
+	find_kernel(simd_avx512, p)(p, start, count, values, nan);
+}
@@ -0,0 +1,42 @@
+#ifndef __SIMD_H__
+#define __SIMD_H__
+
+#include <stdint.h>
+
+#include "program.h"
+
+// Number of vectors evaluated per register in one pass over a program
+#define SIMD_UNROLL 4
+
+// Instruction sets the SIMD engine has kernels for, in increasing order
+typedef enum simd_level
+{
+	simd_scalar,
+	simd_sse2,
+	simd_avx2,
+	simd_avx512
+
+} simd_level;
+
+// Returns the best instruction set supported by the cpu (detected once, at
+// first call).
+simd_level simd_detect();
+
+// Returns 1 if the program can be evaluated by the SIMD engine, otherwise 0.
+int simd_supports(program* p);
+
+// SIMD version of program_run_range. Assignments are packed into 8, 16 or 32
+// bit lanes depending on p->bits, and evaluated with the best kernel for the
+// cpu. Falls back to program_run_range where there is no kernel.
+void simd_run_range(program* p, uint64_t start, uint64_t count, int32_t* values, uint8_t* nan);
+
+// Same as above, for a specific instruction set. These are used to force an
+// instruction set on the command line.
+int simd_sse2_supports(program* p);
+void simd_sse2_run_range(program* p, uint64_t start, uint64_t count, int32_t* values, uint8_t* nan);
+int simd_avx2_supports(program* p);
+void simd_avx2_run_range(program* p, uint64_t start, uint64_t count, int32_t* values, uint8_t* nan);
+int simd_avx512_supports(program* p);
+void simd_avx512_run_range(program* p, uint64_t start, uint64_t count, int32_t* values, uint8_t* nan);
+
+#endif
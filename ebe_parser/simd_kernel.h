@@ -0,0 +1,170 @@
+// SIMD lane kernel template, included by simd.c once per instruction set and
+// lane width. Before including define:
+//
+// SIMD_KERNEL_NAME   name of the kernel function
+// SIMD_LANE_TYPE     unsigned integer type of one lane (one assignment)
+// SIMD_VECTOR_BYTES  size of a vector register in bytes
+//
+// The kernel has the signature of program_run_range. Every register of the
+// program holds SIMD_UNROLL vectors, so one pass over the program evaluates
+// SIMD_UNROLL * lanes consecutive assignments. start must be a multiple of
+// that block size.
+
+static void SIMD_KERNEL_NAME(program* p, uint64_t start, uint64_t count, int32_t* values, uint8_t* nan)
+{
+	typedef SIMD_LANE_TYPE lane_t;
+	typedef lane_t vec_t __attribute__((vector_size(SIMD_VECTOR_BYTES)));
+
+	const size_t lanes = SIMD_VECTOR_BYTES / sizeof(lane_t);
+	const uint64_t block_size = lanes * SIMD_UNROLL;
+
+	size_t n = p->variable_count;
+	uint32_t bits = p->bits;
+
+	vec_t* regs = 0;
+	vec_t* patterns = 0;
+	vec_t nan_vec[SIMD_UNROLL];
+
+	const vec_t zero = { 0 };
+	const vec_t one = zero + 1;
+	const vec_t mask = zero + (lane_t)p->mask;
+	const vec_t width = zero + (lane_t)bits;
+	vec_t ok;
+	vec_t divisor;
+
+	vec_t* r;
+	vec_t* a;
+	vec_t* b;
+	instruction* in;
+
+	uint64_t block;
+	uint64_t end = start + count;
+	uint64_t remaining;
+	uint64_t offset;
+	uint32_t shift;
+	size_t i, k, u, lane;
+
+	if (posix_memalign((void**)&regs, SIMD_VECTOR_BYTES, sizeof(vec_t) * SIMD_UNROLL * p->length) != 0 ||
+		posix_memalign((void**)&patterns, SIMD_VECTOR_BYTES, sizeof(vec_t) * SIMD_UNROLL * (n + 1)) != 0)
+	{
+		elog(LOG_FATAL_ERROR, "simd_run_range: out of memory\n");
+	}
+
+	if (start % block_size != 0)
+	{
+		elog(LOG_FATAL_ERROR, "simd_run_range: start (%d) is not a multiple of %d\n", (int)start, (int)block_size);
+	}
+
+	// The digit of a variable in the assignment index at offset from the
+	// start of a block is (offset >> shift) plus the digit of the block
+	// start, since blocks are aligned. Only the second part changes between
+	// blocks.
+	for (k=0; k<n; k++)
+	{
+		shift = bits * (uint32_t)(n - 1 - k);
+
+		for (u=0; u<SIMD_UNROLL; u++)
+		{
+			for (lane=0; lane<lanes; lane++)
+			{
+				offset = u * lanes + lane;
+				patterns[k * SIMD_UNROLL + u][lane] = (lane_t)(shift < 64 ? offset >> shift : 0);
+			}
+		}
+	}
+
+	for (block = start; block < end; block += block_size)
+	{
+		for (u=0; u<SIMD_UNROLL; u++)
+		{
+			nan_vec[u] = zero;
+		}
+
+		for (i=0; i<p->length; i++)
+		{
+			in = &p->code[i];
+			r = regs + i * SIMD_UNROLL;
+			a = regs + in->a * SIMD_UNROLL;
+			b = regs + in->b * SIMD_UNROLL;
+
+			switch (in->op)
+			{
+				case op_const:
+					for (u=0; u<SIMD_UNROLL; u++) r[u] = zero + (lane_t)in->a;
+					break;
+				case op_var:
+					shift = bits * (uint32_t)(n - 1 - in->a);
+					for (u=0; u<SIMD_UNROLL; u++)
+					{
+						r[u] = (patterns[in->a * SIMD_UNROLL + u] + (lane_t)(shift < 64 ? block >> shift : 0)) & mask;
+					}
+					break;
+				case op_mul:
+					for (u=0; u<SIMD_UNROLL; u++) r[u] = (a[u] * b[u]) & mask;
+					break;
+				case op_div:
+				case op_mod:
+					for (u=0; u<SIMD_UNROLL; u++)
+					{
+						// divide by one where the divisor is zero, and flag the lane
+						ok = (vec_t)(b[u] == zero);
+						nan_vec[u] |= ok;
+						divisor = b[u] | (ok & one);
+						r[u] = (in->op == op_div ? a[u] / divisor : a[u] % divisor) & mask;
+					}
+					break;
+				case op_add:
+					for (u=0; u<SIMD_UNROLL; u++) r[u] = (a[u] + b[u]) & mask;
+					break;
+				case op_sub:
+					for (u=0; u<SIMD_UNROLL; u++) r[u] = (a[u] - b[u]) & mask;
+					break;
+				case op_shl:
+				case op_shr:
+					for (u=0; u<SIMD_UNROLL; u++)
+					{
+						// shifting by the width or more clears the lane
+						ok = (vec_t)(b[u] < width);
+						r[u] = (in->op == op_shl ? a[u] << (b[u] & ok) : a[u] >> (b[u] & ok)) & ok & mask;
+					}
+					break;
+				case op_and:
+					for (u=0; u<SIMD_UNROLL; u++) r[u] = a[u] & b[u];
+					break;
+				case op_xor:
+					for (u=0; u<SIMD_UNROLL; u++) r[u] = a[u] ^ b[u];
+					break;
+				case op_or:
+					for (u=0; u<SIMD_UNROLL; u++) r[u] = a[u] | b[u];
+					break;
+				case op_minus:
+					for (u=0; u<SIMD_UNROLL; u++) r[u] = (zero - a[u]) & mask;
+					break;
+				case op_negate:
+					for (u=0; u<SIMD_UNROLL; u++) r[u] = ~a[u] & mask;
+					break;
+				default:
+					for (u=0; u<SIMD_UNROLL; u++) r[u] = zero;
+					break;
+			}
+		}
+
+		// lanes past the end were evaluated, but aren't copied out
+		r = regs + (p->length - 1) * SIMD_UNROLL;
+		remaining = end - block;
+
+		if (remaining > block_size)
+		{
+			remaining = block_size;
+		}
+
+		for (offset=0; offset<remaining; offset++)
+		{
+			values[block - start + offset] = (int32_t)r[offset / lanes][offset % lanes];
+			nan[block - start + offset] = nan_vec[offset / lanes][offset % lanes] != 0;
+		}
+	}
+
+	free(patterns);
+	free(regs);
+}
@@ -50,11 +50,12 @@ function run_test()
 	}
 	fi
 	
-	eval ./ebe "\"$1\"" -o $test_filename -b $bits >/dev/null
+	# any further arguments are passed on to ebe
+	eval ./ebe "\"$1\"" -o $test_filename -b $bits "${@:4}" >/dev/null
 	
 	total_test=$((total_test + 1))
 
-	test_md5=`grep "md5" $test_filename | awk '{$1=$2=""; print $0}' | sed 's/^ *//g'`
+	test_md5=`grep -E "eval (md5|hash):" $test_filename | awk '{$1=$2=""; print $0}' | sed 's/^ *//g'`
 
 	if [ $test_md5 == $2 ]
 	then
@@ -72,6 +73,225 @@ function run_test()
 	fi
 }
 
+# Runs several expressions through one batch (-B). Expressions are
+# separated by ';', and so are the expected md5s.
+function run_batch_test()
+{
+	echo "$1" | tr ';' '\n' | ./ebe -B -o $test_filename -b $3 "${@:4}" >/dev/null
+	
+	total_test=$((total_test + 1))
+
+	test_md5=`grep -E "eval (md5|hash|class):" $test_filename | awk '{print $3}' | paste -sd ';'`
+
+	if [ "$test_md5" == "$2" ]
+	then
+	{
+		pass_count=$((pass_count + 1))
+	}
+	else
+	{
+		fail_count=$((fail_count + 1))
+		echo -e '\E[47;31m'"\033[1mBatch test failed for \"$1\"\033[0m" 
+		tput sgr0
+		
+		echo "md5s from failed test: $test_md5"
+	}
+	fi
+}
+
+# Evaluates an expression in slices (--range), separated by ';', merges
+# them, and checks the tree fingerprint. Without slices the fingerprint of
+# the whole expression (--tree) is checked.
+function run_merge_test()
+{
+	rm -f $test_filename.parts
+	
+	for range in `echo "$4" | tr ';' ' '`
+	do
+		./ebe -o $test_filename -b $3 --range=$range "${@:5}" "$1" >/dev/null
+		cat $test_filename >> $test_filename.parts
+	done
+	
+	if [ -z "$4" ]
+	then
+		./ebe -o $test_filename.parts -b $3 --tree "${@:5}" "$1" >/dev/null
+	else
+		./ebe -o $test_filename --merge < $test_filename.parts >/dev/null
+		cat $test_filename >> $test_filename.parts
+	fi
+	
+	total_test=$((total_test + 1))
+
+	test_tree=`grep "eval tree" $test_filename.parts | awk '{print $3}'`
+	rm -f $test_filename.parts
+
+	if [ "$test_tree" == "$2" ]
+	then
+	{
+		pass_count=$((pass_count + 1))
+	}
+	else
+	{
+		fail_count=$((fail_count + 1))
+		echo -e '\E[47;31m'"\033[1mMerge test failed for \"$1\"\033[0m" 
+		tput sgr0
+		
+		echo "tree from failed test: $test_tree"
+	}
+	fi
+}
+
+# Evaluates one slice (--range) of an expression and checks the md5 of the
+# values in it, for widths too large to evaluate whole.
+function run_range_test()
+{
+	./ebe -o $test_filename -b $3 --range=$4 "${@:5}" "$1" >/dev/null
+	
+	total_test=$((total_test + 1))
+
+	test_md5=`grep "eval node" $test_filename | awk '{print $5}'`
+
+	if [ "$test_md5" == "$2" ]
+	then
+	{
+		pass_count=$((pass_count + 1))
+	}
+	else
+	{
+		fail_count=$((fail_count + 1))
+		echo -e '\E[47;31m'"\033[1mRange test failed for \"$1\"\033[0m" 
+		tput sgr0
+		
+		echo "md5 from failed test: $test_md5"
+	}
+	fi
+}
+
+# Checks the md5 of every expression gen writes for NUM variables
+function run_gen_test()
+{
+	test_md5=`./gen "${@:3}" $1 | md5sum | awk '{print $1}'`
+	
+	total_test=$((total_test + 1))
+
+	if [ "$test_md5" == "$2" ]
+	then
+	{
+		pass_count=$((pass_count + 1))
+	}
+	else
+	{
+		fail_count=$((fail_count + 1))
+		echo -e '\E[47;31m'"\033[1mGen test failed for $1 ${@:3}\033[0m" 
+		tput sgr0
+		
+		echo "md5 from failed test: $test_md5"
+	}
+	fi
+}
+
+# Checks that gen with the given arguments writes the full run for NUM
+# variables from the line with ID on. An empty ID is the whole run.
+function run_gen_resume_test()
+{
+	./gen $1 > $test_filename.gen
+	
+	if [ -z "$2" ]
+	then
+		cp $test_filename.gen $test_filename.expected
+	else
+		sed -n "/^phase_4: $2: /,\$p" $test_filename.gen > $test_filename.expected
+	fi
+	
+	./gen $1 "${@:3}" > $test_filename
+	
+	total_test=$((total_test + 1))
+
+	if [ -s $test_filename.expected ] && cmp -s $test_filename $test_filename.expected
+	then
+	{
+		pass_count=$((pass_count + 1))
+	}
+	else
+	{
+		fail_count=$((fail_count + 1))
+		echo -e '\E[47;31m'"\033[1mGen resume test failed for $1 ${@:3}\033[0m" 
+		tput sgr0
+		
+		echo "first line from failed test: `head -1 $test_filename`"
+	}
+	fi
+	
+	rm -f $test_filename.gen $test_filename.expected
+}
+
+# Checks that --shard K/N for K from 1 to N, separated by ';', each
+# concatenate to the full run for NUM variables
+function run_gen_shard_test()
+{
+	./gen $1 > $test_filename.gen
+	
+	for shards in `echo "$2" | tr ';' ' '`
+	do
+		for k in `seq 1 $shards`
+		do
+			./gen $1 --shard $k/$shards
+		done > $test_filename
+		
+		total_test=$((total_test + 1))
+
+		if cmp -s $test_filename $test_filename.gen
+		then
+		{
+			pass_count=$((pass_count + 1))
+		}
+		else
+		{
+			fail_count=$((fail_count + 1))
+			echo -e '\E[47;31m'"\033[1mGen shard test failed for $1 in $shards shards\033[0m" 
+			tput sgr0
+		}
+		fi
+	done
+	
+	rm -f $test_filename.gen
+}
+
+# Checks that --id reproduces every STEP-th line of the full run for NUM
+# variables, and its last line
+function run_gen_id_test()
+{
+	./gen $1 > $test_filename.gen
+	
+	total_test=$((total_test + 1))
+	failed=""
+
+	for line in `(awk "NR % $2 == 1" $test_filename.gen; tail -1 $test_filename.gen) | awk '{print $2}' | tr -d ':'`
+	do
+		if [ "`./gen --id $line`" != "`grep -m1 "^phase_4: $line: " $test_filename.gen`" ]
+		then
+			failed="$failed $line"
+		fi
+	done
+	
+	if [ -z "$failed" ]
+	then
+	{
+		pass_count=$((pass_count + 1))
+	}
+	else
+	{
+		fail_count=$((fail_count + 1))
+		echo -e '\E[47;31m'"\033[1mGen id test failed for $1\033[0m" 
+		tput sgr0
+		
+		echo "ids from failed test:$failed"
+	}
+	fi
+	
+	rm -f $test_filename.gen
+}
+
 # one variable
 run_test 'a&a' "1e7b750959daf9c717bee4112d9a7eec"
 run_test 'a|a' "1e7b750959daf9c717bee4112d9a7eec"
@@ -115,6 +335,10 @@ run_test '~a&~b' "f3216a8a2e1b547fc99e69a5b17f4324"
 run_test '~a|~b' "ba8cf3db9686a44f59d74728d04a4b4d"
 run_test 'a|b|~b' "1e68819f09ca1283d0dcb678870983e8"
 
+# shifts by the width or more still carry a nan from their left operand
+run_test '((a/0)<<40)' "bc3cd0ca203b32a6e8485b325848f3bc" 6 --check
+run_test '((a%b)>>c)' "08502b3532b3f71cf8da3eb4b9ab6bdd" 6 --check
+
 # parantheses and negates
 run_test 'a&b|a' "ccf4850363197298b34e0b246f7c9b19"
 run_test '(a&b)|a' "ccf4850363197298b34e0b246f7c9b19"
@@ -146,5 +370,134 @@ run_test 'a-b' "0764e0526f26a0562d3d69c8c554ec70" 2
 run_test 'a/b' "5d8739df3e67bbdf27d82d5a261708f9" 2
 run_test 'a%b' "13e1bae98bd6e8f8d04cb4cce1588e9a" 2
 
+# many variables, more than one word (and block) of bit-sliced assignments
+
+run_test 'a&b&c&d&e&f&g' "cd3704cd838417a259a74e6155061bdb"
+run_test '(a|b)^(c&d)^(e+f)*g-h' "b2066e88e97b148e8f5ce9bf01545675"
+run_test '(p&q|r^s)*(t-u)/(v|w)%(x+y)^~(z&o)-m' "67412c44b8368e3c4a6fc940b58ea9b7"
+run_test '(p&q|r^s)*(t-u)/(v|w)%(x+y)^~(z&o)-m' "67412c44b8368e3c4a6fc940b58ea9b7" 1 -e program
+
+# -b 3 and -b 4, bit-sliced circuits against the scalar program
+
+run_test 'a*b-c/d' "1ed569fb9b7b0090f8fddfa59d4ae559" 3
+run_test 'a*b-c/d' "1ed569fb9b7b0090f8fddfa59d4ae559" 3 -e program
+run_test '(a%b)+(c<<d)-(a>>c)' "39b9b55c0879b17eb6b5fe1ea1248e8b" 3
+run_test '~a*b+-c' "707ce25ac7ffce95ba9d00f1520c5443" 4
+run_test 'a/b%c' "d69cbe9d870860affa3c80782f9922d0" 4
+run_test 'a/b%c' "d69cbe9d870860affa3c80782f9922d0" 4 -e program
+
+# SIMD lanes, with the best kernel for this cpu
+
+run_test 'a/b%c' "d69cbe9d870860affa3c80782f9922d0" 4 -e simd
+run_test '(a%b)+(c<<d)-(a>>c)' "39b9b55c0879b17eb6b5fe1ea1248e8b" 3 -e simd
+run_test '(p&q|r^s)*(t-u)/(v|w)%(x+y)^~(z&o)-m' "67412c44b8368e3c4a6fc940b58ea9b7" 1 -e simd
+
+# native code, checked against the recursive evaluator
+
+run_test 'a*b-c/d' "1ed569fb9b7b0090f8fddfa59d4ae559" 3 -e jit --check
+run_test '(a%b)+(c<<d)-(a>>c)' "39b9b55c0879b17eb6b5fe1ea1248e8b" 3 -e jit --check
+run_test '(p&q|r^s)*(t-u)/(v|w)%(x+y)^~(z&o)-m' "67412c44b8368e3c4a6fc940b58ea9b7" 1 -e jit --check
+
+# kernels specialized for the number of bits
+
+run_test 'a*b-c/d' "1ed569fb9b7b0090f8fddfa59d4ae559" 3 -e width
+run_test 'a/b%c' "d69cbe9d870860affa3c80782f9922d0" 4 -e width --check
+run_test '(p&q|r^s)*(t-u)/(v|w)%(x+y)^~(z&o)-m' "67412c44b8368e3c4a6fc940b58ea9b7" 1 -e width
+
+# operator lookup tables, and user defined operators
+
+run_test 'a/b%c' "d69cbe9d870860affa3c80782f9922d0" 4 -e table
+run_test '(a%b)+(c<<d)-(a>>c)' "39b9b55c0879b17eb6b5fe1ea1248e8b" 3 -e table --check
+run_test 'a#b' "4a2e9d50991e66d97ca5fa1d9cc13509" 2 --operator=#=6
+run_test 'a#b&c' "20648a55dcfbd5d89e23fc43a614ae4b" 2 --operator=#=6 --check
+run_test 'a@b' "397588515770e8d236df6ad40bc262f7" 1 --operator=@=0,1,1,n
+
+# Gray code order, only what depends on the changed variable is run again
+
+run_test 'a*b-c/d' "1ed569fb9b7b0090f8fddfa59d4ae559" 3 -e gray --check
+run_test '(p&q|r^s)*(t-u)/(v|w)%(x+y)^~(z&o)-m' "67412c44b8368e3c4a6fc940b58ea9b7" 1 -e gray
+
+# several threads, chunks are hashed in order so the md5 doesn't change
+
+run_test '(p&q|r^s)*(t-u)/(v|w)%(x+y)^~(z&o)-m' "67412c44b8368e3c4a6fc940b58ea9b7" 1 -j 4
+run_test 'a*b-c/d+e%f' "4e25b7bbebca43592a6e127997c4017b" 2 -j 3 -e jit --check
+
+# the fast fingerprint of the packed values and nan, the same from every
+# engine and in batches
+
+run_test 'a*b-c/d' "fbbbfe8dbedfc069d200c0e43b85235f" 2 --fast -e program
+run_test 'a*b-c/d' "fbbbfe8dbedfc069d200c0e43b85235f" 2 --fast -j 3
+run_batch_test 'a*b-c^d;a/b-c^d;a%b-c/d' "ba545271587b02f754d0ca995b71b771;a9d8308db5197e9d37f0a5ba7b979628;f3b8ae592bac33766a906996788069ed" 3 --fast
+
+# constants folded, identities simplified and repeated subexpressions
+# merged, keeping the nan of a dropped division
+
+run_test '((a-a)+(b*1))|((c&0)^(d|~d))' "efe439b7f44046770f17521a1e56d868" 2 --check
+run_test '((a/b)*0)+((c%d)-(c%d))' "5c5d357d8b1d3a0ca9953bd1c6352d6c" 2 --check
+run_test '((a/b)*0)+((c%d)-(c%d))' "5c5d357d8b1d3a0ca9953bd1c6352d6c" 2 --no-optimize
+
+# several widths from one evaluation at the highest, or one at a time
+# when the expression divides
+
+run_batch_test '(a*b+c)-(~a^b)' "8697dfe0cd80fd3fabbc8bc699c8db4d;65f5546a6f8f482876321b31b811084a;4dc651ede671383c7fd10f64cb4560c1;5d7c4225e033ec6f78519392ed64d797" 1 --bits-range=1-4 --check
+run_batch_test 'a/b+c<<1' "df20feb9144846bc9a5ae18b57a0de0a;4e202f9876660e20cdb55c6db3f377c7;a22346847b29b7123002b1d9d8fdf41e" 1 --bits-range=2-4
+
+# slices of the assignments, merged into the tree fingerprint
+
+run_merge_test 'a*b-c/d+e%f' "d89b5d8c9bc925d46de03a26e085d4c4" 3 ""
+run_merge_test 'a*b-c/d+e%f' "d89b5d8c9bc925d46de03a26e085d4c4" 3 "0:4096;4096:12288;12288:200704;200704:262144" -j 2
+run_merge_test 'a&b' "e8b1e6109bdd6a20460f3c3daefebfa6" 1 "0:4"
+
+# the top of the widest values, eval agrees with the engines
+run_range_test '(a/3)' "b435380b8eb799234e6e857b4c2fc774" 32 "4294963200:4294967296" --check
+run_range_test '(a%7)-(a>>31)' "b978b951899cc5b07a46f7b10d6463b7" 32 "4294963200:4294967296" --check -e jit
+
+# batches, neighbouring expressions share truth tables
+
+run_batch_test 'a*b-c/d;a*b-c%d;a*b-c/d;a+b-c/d' "1ed569fb9b7b0090f8fddfa59d4ae559;e45a6e62bf3201b74378989b35198197;1ed569fb9b7b0090f8fddfa59d4ae559;5d774d4036e8fd77b9b823c5199798b2" 3 --check
+run_batch_test 'a^b;a|b;a%b' "4a2e9d50991e66d97ca5fa1d9cc13509;efe0f50c1e5168f55461f0758088e7b9;13e1bae98bd6e8f8d04cb4cce1588e9a" 2
+
+# batches, expressions of the same shape are evaluated together in lanes
+
+run_batch_test 'a*b-c;a/b-c;a%b-c;a+b-c;a<<b-c' "7c6210c272b652b20334117cf8deeac4;d6c9044ce5ff1d4a3d99086a2f79c736;a13af66d558112ea444721daca421af8;b426b468977ed02a841af37882918419;1de978cde34e688e5414b8a18e1a4805" 3 --check
+
+# batches, the md5s of a group are worked out together, one per vector lane
+
+run_batch_test 'a*b-c^d;a/b-c^d;a%b-c^d;a+b-c^d;a<<b-c^d;a>>b-c^d;a&b-c^d;a|b-c^d;a^b-c^d;a-b-c^d' "9d5dea3a371117ba6b0d4d4859d89e9b;7a45960698e0c27a546019691e5d6e47;b6476f10d967d665e22de3b4f9b0f10a;91db4dc6828cfd87aa8772a45a086720;20dc295c8d89b4b48257e05a6c720658;cc555af66a1cdb1d5d1bb26ff9c02e76;04e12e94b2e5d610e645497fdb5f2361;0b70b907359af5f4fbcf8f4aa2bbb8e2;e4085a8c543de8c7c6405667986c1fac;bc59c02d95aeec2ad26ea5c08197e854" 3
+
+# batches, the line of the first expression with the same values, probed
+# at a few assignments and evaluated in full where the probes agree, or
+# probed at every assignment
+
+run_batch_test 'a+b;b+a;a*b;(a^b)+((a&b)*2);a|b;b*a' "1;1;3;1;5;3" 4 --unique
+run_batch_test 'a&b;~(~a|~b);a|b;7;3+4' "1;1;3;4;4" 1 --unique
+
+# batches, subtrees are found in the table cache wherever they appear
+
+run_batch_test 'a*b-c/d;a+b-c%d;c/d-a*b;a*b+c%d' "1ed569fb9b7b0090f8fddfa59d4ae559;15bc5f1cc409dbe76bb079eda9b864b3;ed98063ff27239cab86cd42344ad07ac;beefaa93d635365e899cb9b9ff17baec" 3 --check
+run_batch_test 'a*b-c/d;a+b-c%d;c/d-a*b;a*b+c%d' "1ed569fb9b7b0090f8fddfa59d4ae559;15bc5f1cc409dbe76bb079eda9b864b3;ed98063ff27239cab86cd42344ad07ac;beefaa93d635365e899cb9b9ff17baec" 3 --cache=0
+
+# gen, every expression of a few variables, ids pinned by md5
+
+run_gen_test 1 "6aebf20a852566169f2538d55559808d"
+run_gen_test 2 "4ca9b7fd287c6786919006a94f099256"
+run_gen_test 3 "2bc48962e4a200e0aacb4c9cade4de74"
+
+# gen, -a to -d continue after their ids, 0 and id_b_offset before the first
+
+run_gen_resume_test 3 "" -a 0
+run_gen_resume_test 3 "" -a 0 -b 3 -c 0 -d 0
+run_gen_resume_test 2 "2.1.3.1.1" -a 0 -b 2
+run_gen_resume_test 3 "3.2.4.1.1" -a 1
+run_gen_resume_test 3 "3.1.5.1.1" -a 0 -b 4
+run_gen_resume_test 3 "3.2.6.1.5" -a 1 -b 5 -c 0 -d 4
+run_gen_resume_test 3 "3.1.8.17.3" -a 0 -b 7 -c 16 -d 2
+
+# gen, shards concatenate to the full run, and --id gives single lines
+
+run_gen_shard_test 3 "1;7;32"
+run_gen_shard_test 2 "1000"
+run_gen_id_test 3 4999
+run_gen_id_test 2 7
 
 echo "pass=$pass_count, fail=$fail_count, total=$total_test"
\ No newline at end of file
@@ -0,0 +1,338 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "tree.h"
+#include "log.h"
+
+// http://openwall.info/wiki/people/solar/software/public-domain-source-code/md5
+#include "md5/md5.h"
+
+// node read back by tree_merge, in chunks
+typedef struct tree_part
+{
+	uint64_t lo;
+	uint64_t hi;
+	tree_digest digest;
+
+} tree_part;
+
+// number of chunks in the left child of a node of n > 1 chunks
+static uint64_t left_size(uint64_t n)
+{
+	uint64_t k = 1;
+
+	while (k * 2 < n)
+	{
+		k *= 2;
+	}
+
+	return k;
+}
+
+static void combine(tree_digest* left, tree_digest* right, tree_digest* out)
+{
+	MD5_CTX ctx;
+	unsigned char tag = 1;
+
+	// the tag keeps a node from ever hashing like a leaf
+	MD5_Init(&ctx);
+	MD5_Update(&ctx, &tag, 1);
+	MD5_Update(&ctx, left->bytes, 16);
+	MD5_Update(&ctx, right->bytes, 16);
+	MD5_Final(out->bytes, &ctx);
+}
+
+static void printf_digest(tree_digest* d)
+{
+	int i;
+
+	for (i=0; i<16; i++)
+	{
+		felog_d(LOG_NORMAL, "%.02x", d->bytes[i]);
+	}
+}
+
+// Adds the largest nodes under lo..hi inside the slice of chunks
+// first..end-1, in order
+static void find_nodes(tree_stream* s, uint64_t first, uint64_t end, uint64_t lo, uint64_t hi)
+{
+	uint64_t k;
+
+	if (hi <= first || lo >= end)
+	{
+		return;
+	}
+
+	if (lo >= first && hi <= end)
+	{
+		if (s->node_count == TREE_MAX_NODES)
+		{
+			elog(LOG_FATAL_ERROR, "find_nodes: more than %d nodes\n", TREE_MAX_NODES);
+		}
+
+		s->lo[s->node_count] = lo;
+		s->hi[s->node_count] = hi;
+		s->node_count++;
+		return;
+	}
+
+	k = left_size(hi - lo);
+
+	find_nodes(s, first, end, lo, lo + k);
+	find_nodes(s, first, end, lo + k, hi);
+}
+
+void tree_stream_init(tree_stream* s, uint64_t start, uint64_t end, uint64_t total)
+{
+	s->start = start;
+	s->end = end;
+	s->total = total;
+	s->node_count = 0;
+	s->current = 0;
+	s->added = 0;
+	s->depth = 0;
+
+	find_nodes(s, start / TREE_CHUNK_SIZE, (end + TREE_CHUNK_SIZE - 1) / TREE_CHUNK_SIZE,
+		0, (total + TREE_CHUNK_SIZE - 1) / TREE_CHUNK_SIZE);
+}
+
+// A node of n chunks is a perfect tree of the largest power of two below n
+// on the left, and the rest on the right. So are its right children, which
+// makes a node the perfect trees of the powers of two in n, largest first,
+// folded from the right. The perfect trees are built like a binary counter.
+void tree_stream_add(tree_stream* s, tree_digest* leaf)
+{
+	tree_digest* out;
+	int i;
+
+	if (s->current == s->node_count)
+	{
+		elog(LOG_FATAL_ERROR, "tree_stream_add: more leaves than the slice has\n");
+	}
+
+	s->stack[s->depth] = *leaf;
+	s->sizes[s->depth] = 1;
+	s->depth++;
+
+	while (s->depth >= 2 && s->sizes[s->depth - 1] == s->sizes[s->depth - 2])
+	{
+		combine(&s->stack[s->depth - 2], &s->stack[s->depth - 1], &s->stack[s->depth - 2]);
+		s->sizes[s->depth - 2] *= 2;
+		s->depth--;
+	}
+
+	s->added++;
+
+	if (s->added < s->hi[s->current] - s->lo[s->current])
+	{
+		return;
+	}
+
+	out = &s->digests[s->current];
+	*out = s->stack[s->depth - 1];
+
+	for (i = s->depth - 2; i >= 0; i--)
+	{
+		combine(&s->stack[i], out, out);
+	}
+
+	s->current++;
+	s->added = 0;
+	s->depth = 0;
+}
+
+void printf_tree_root(tree_stream* s)
+{
+	if (s->start != 0 || s->end != s->total || s->current != 1)
+	{
+		elog(LOG_FATAL_ERROR, "printf_tree_root: the tree is missing leaves\n");
+	}
+
+	felog_d(LOG_NORMAL, "eval tree: ");
+	printf_digest(&s->digests[0]);
+	felog_d(LOG_NORMAL, "\n");
+}
+
+void printf_tree_range(tree_stream* s)
+{
+	size_t i;
+
+	if (s->current != s->node_count)
+	{
+		elog(LOG_FATAL_ERROR, "printf_tree_range: the slice is missing leaves\n");
+	}
+
+	felog_d(LOG_NORMAL, "eval range: %llu %llu %llu\n",
+		(unsigned long long)s->start, (unsigned long long)s->end, (unsigned long long)s->total);
+
+	for (i=0; i<s->node_count; i++)
+	{
+		felog_d(LOG_NORMAL, "eval node: %llu %llu ", (unsigned long long)(s->lo[i] * TREE_CHUNK_SIZE),
+			(unsigned long long)(s->hi[i] * TREE_CHUNK_SIZE < s->total ? s->hi[i] * TREE_CHUNK_SIZE : s->total));
+		printf_digest(&s->digests[i]);
+		felog_d(LOG_NORMAL, "\n");
+	}
+}
+
+static int compare_parts(const void* a, const void* b)
+{
+	const tree_part* x = (const tree_part*)a;
+	const tree_part* y = (const tree_part*)b;
+
+	return x->lo < y->lo ? -1 : x->lo > y->lo;
+}
+
+// Hash of the node over chunks lo..hi-1 from the parts that were read,
+// sorted and without gaps
+static void merge_node(tree_part* parts, size_t part_count, uint64_t lo, uint64_t hi, tree_digest* out)
+{
+	tree_digest left;
+	tree_digest right;
+	size_t low = 0;
+	size_t high = part_count;
+	size_t mid;
+	uint64_t k;
+
+	while (low < high)
+	{
+		mid = (low + high) / 2;
+
+		if (parts[mid].lo < lo)
+		{
+			low = mid + 1;
+		}
+		else
+		{
+			high = mid;
+		}
+	}
+
+	if (low < part_count && parts[low].lo == lo && parts[low].hi == hi)
+	{
+		*out = parts[low].digest;
+		return;
+	}
+
+	if (hi - lo == 1)
+	{
+		elog(LOG_EXIT_ERROR, "Slices don't line up with the tree at assignment %llu\n",
+			(unsigned long long)(lo * TREE_CHUNK_SIZE));
+		exit(1);
+	}
+
+	k = left_size(hi - lo);
+
+	merge_node(parts, part_count, lo, lo + k, &left);
+	merge_node(parts, part_count, lo + k, hi, &right);
+	combine(&left, &right, out);
+}
+
+void tree_merge(FILE* f)
+{
+	char* line = 0;
+	size_t line_size = 0;
+	char hex[33];
+	unsigned long long lo, hi, end, total;
+	unsigned int byte;
+	int have_total = 0;
+	uint64_t expected_total = 0;
+	uint64_t chunk_count;
+	uint64_t next;
+	tree_part* parts = 0;
+	tree_part* grown;
+	size_t part_count = 0;
+	size_t part_size = 0;
+	size_t i;
+	int j;
+	tree_digest root;
+
+	while (getline(&line, &line_size, f) != -1)
+	{
+		if (sscanf(line, "eval range: %llu %llu %llu", &lo, &end, &total) == 3)
+		{
+			if (have_total && total != expected_total)
+			{
+				elog(LOG_EXIT_ERROR, "Slices are from different expressions or bits (%llu and %llu assignments)\n",
+					(unsigned long long)expected_total, total);
+				exit(1);
+			}
+
+			have_total = 1;
+			expected_total = total;
+		}
+		else if (sscanf(line, "eval node: %llu %llu %32s", &lo, &hi, hex) == 3)
+		{
+			if (strlen(hex) != 32 || lo % TREE_CHUNK_SIZE != 0 || hi <= lo)
+			{
+				elog(LOG_EXIT_ERROR, "Bad node: %s", line);
+				exit(1);
+			}
+
+			if (part_count == part_size)
+			{
+				part_size = part_size == 0 ? 64 : part_size * 2;
+				grown = (tree_part*)realloc(parts, sizeof(tree_part) * part_size);
+
+				if (grown == 0)
+				{
+					elog(LOG_FATAL_ERROR, "tree_merge: out of memory\n");
+				}
+
+				parts = grown;
+			}
+
+			parts[part_count].lo = lo / TREE_CHUNK_SIZE;
+			parts[part_count].hi = (hi + TREE_CHUNK_SIZE - 1) / TREE_CHUNK_SIZE;
+
+			for (j=0; j<16; j++)
+			{
+				sscanf(hex + 2 * j, "%2x", &byte);
+				parts[part_count].digest.bytes[j] = (unsigned char)byte;
+			}
+
+			part_count++;
+		}
+	}
+
+	free(line);
+
+	if (!have_total || part_count == 0)
+	{
+		elog(LOG_EXIT_ERROR, "No slices to merge\n");
+		exit(1);
+	}
+
+	qsort(parts, part_count, sizeof(tree_part), compare_parts);
+
+	chunk_count = (expected_total + TREE_CHUNK_SIZE - 1) / TREE_CHUNK_SIZE;
+	next = 0;
+
+	for (i=0; i<part_count; i++)
+	{
+		if (parts[i].lo != next)
+		{
+			elog(LOG_EXIT_ERROR, "Slices %s at assignment %llu\n",
+				parts[i].lo < next ? "overlap" : "are missing",
+				(unsigned long long)(next * TREE_CHUNK_SIZE));
+			exit(1);
+		}
+
+		next = parts[i].hi;
+	}
+
+	if (next != chunk_count)
+	{
+		elog(LOG_EXIT_ERROR, "Slices are missing at assignment %llu\n", (unsigned long long)(next * TREE_CHUNK_SIZE));
+		exit(1);
+	}
+
+	merge_node(parts, part_count, 0, chunk_count, &root);
+
+	felog_d(LOG_NORMAL, "eval tree: ");
+	printf_digest(&root);
+	felog_d(LOG_NORMAL, "\n");
+
+	free(parts);
+}
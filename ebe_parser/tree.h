@@ -0,0 +1,88 @@
+#ifndef __TREE_H__
+#define __TREE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "engine.h"
+
+// Tree fingerprint of an expression. The assignments are cut into chunks
+// of TREE_CHUNK_SIZE, and each chunk is hashed (md5 of the same "%d," text
+// as the eval md5) into a leaf. Leaves are combined pairwise into a binary
+// tree, where a node of n > 1 chunks has a left child of the largest power
+// of two below n chunks, and the rest on the right. Unlike the eval md5 a
+// slice of the assignments can be hashed on its own into the nodes it
+// covers, and the nodes of all slices merged into the root later.
+//
+// A slice is printed as
+//
+//   eval range: START END TOTAL
+//   eval node: LO HI HASH
+//   ...
+//
+// with assignment indices, and the root as "eval tree: HASH".
+
+// number of assignments in a leaf
+#define TREE_CHUNK_SIZE EVAL_CHUNK_SIZE
+
+// hash of a leaf or node
+typedef struct tree_digest
+{
+	unsigned char bytes[16];
+
+} tree_digest;
+
+// most nodes a slice is printed as, at most two on each level of the tree
+#define TREE_MAX_NODES 128
+
+// Nodes of the tree over a slice of the assignments, built from the leaves
+// of its chunks as they come, in order. A node only keeps one perfect
+// subtree of each size while it is built, so memory doesn't grow with the
+// number of assignments.
+typedef struct tree_stream
+{
+	// assignments start to end-1 out of total
+	uint64_t start;
+	uint64_t end;
+	uint64_t total;
+
+	// the largest nodes inside the slice, in chunks, and their hashes
+	uint64_t lo[TREE_MAX_NODES];
+	uint64_t hi[TREE_MAX_NODES];
+	tree_digest digests[TREE_MAX_NODES];
+	size_t node_count;
+
+	// node being built, and the number of its leaves added so far
+	size_t current;
+	uint64_t added;
+
+	// perfect subtrees of the node being built, largest first, and their
+	// number of leaves
+	tree_digest stack[64];
+	uint64_t sizes[64];
+	int depth;
+
+} tree_stream;
+
+// Starts the nodes of the slice of assignments start to end-1, out of
+// total. start must be a multiple of TREE_CHUNK_SIZE, and end too unless it
+// is total.
+void tree_stream_init(tree_stream* s, uint64_t start, uint64_t end, uint64_t total);
+
+// Adds the leaf of the next chunk of the slice
+void tree_stream_add(tree_stream* s, tree_digest* leaf);
+
+// Prints the root of the tree, from a slice of every assignment. LOG_NORMAL
+void printf_tree_root(tree_stream* s);
+
+// Prints the nodes covering the slice, after all of its leaves were
+// added. LOG_NORMAL
+void printf_tree_range(tree_stream* s);
+
+// Reads slices printed by printf_tree_range (other lines are skipped), and
+// prints the root of the whole tree. The slices must cover every assignment
+// exactly once.
+void tree_merge(FILE* f);
+
+#endif
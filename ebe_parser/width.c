@@ -0,0 +1,93 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "width.h"
+#include "program.h"
+#include "log.h"
+
+typedef void (*width_kernel)(program* p, uint64_t start, uint64_t count, int32_t* values, uint8_t* nan);
+
+// Kernels are instantiated from width_kernel.h once per number of bits. Every
+// width fits in 8 bits, which gives the most values per vector register.
+
+#define WIDTH_TYPE uint8_t
+
+#define WIDTH_KERNEL_NAME width_run_range_1
+#define WIDTH_BITS 1
+#include "width_kernel.h"
+#undef WIDTH_KERNEL_NAME
+#undef WIDTH_BITS
+
+#define WIDTH_KERNEL_NAME width_run_range_2
+#define WIDTH_BITS 2
+#include "width_kernel.h"
+#undef WIDTH_KERNEL_NAME
+#undef WIDTH_BITS
+
+#define WIDTH_KERNEL_NAME width_run_range_3
+#define WIDTH_BITS 3
+#include "width_kernel.h"
+#undef WIDTH_KERNEL_NAME
+#undef WIDTH_BITS
+
+#define WIDTH_KERNEL_NAME width_run_range_4
+#define WIDTH_BITS 4
+#include "width_kernel.h"
+#undef WIDTH_KERNEL_NAME
+#undef WIDTH_BITS
+
+#define WIDTH_KERNEL_NAME width_run_range_5
+#define WIDTH_BITS 5
+#include "width_kernel.h"
+#undef WIDTH_KERNEL_NAME
+#undef WIDTH_BITS
+
+#define WIDTH_KERNEL_NAME width_run_range_6
+#define WIDTH_BITS 6
+#include "width_kernel.h"
+#undef WIDTH_KERNEL_NAME
+#undef WIDTH_BITS
+
+#define WIDTH_KERNEL_NAME width_run_range_7
+#define WIDTH_BITS 7
+#include "width_kernel.h"
+#undef WIDTH_KERNEL_NAME
+#undef WIDTH_BITS
+
+#define WIDTH_KERNEL_NAME width_run_range_8
+#define WIDTH_BITS 8
+#include "width_kernel.h"
+#undef WIDTH_KERNEL_NAME
+#undef WIDTH_BITS
+
+#undef WIDTH_TYPE
+
+// kernel for each number of bits, index is bits - 1
+static width_kernel kernels[WIDTH_MAX_BITS] =
+{
+	width_run_range_1,
+	width_run_range_2,
+	width_run_range_3,
+	width_run_range_4,
+	width_run_range_5,
+	width_run_range_6,
+	width_run_range_7,
+	width_run_range_8
+};
+
+int width_supports(program* p)
+{
+	return p->bits >= 1 && p->bits <= WIDTH_MAX_BITS && !program_uses_user_operators(p);
+}
+
+void width_run_range(program* p, uint64_t start, uint64_t count, int32_t* values, uint8_t* nan)
+{
+	if (!width_supports(p))
+	{
+		elog(LOG_FATAL_ERROR, "width_run_range: no kernel for this program, bits=%d\n", p->bits);
+	}
+
+	kernels[p->bits - 1](p, start, count, values, nan);
+}
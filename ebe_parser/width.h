@@ -0,0 +1,23 @@
+#ifndef __WIDTH_H__
+#define __WIDTH_H__
+
+#include <stdint.h>
+
+#include "program.h"
+
+// Number of assignments evaluated per register in one pass over a program
+#define WIDTH_BLOCK 256
+
+// Largest number of bits per variable with a specialized kernel
+#define WIDTH_MAX_BITS 8
+
+// Returns 1 if there is a kernel for the width of the program, otherwise 0.
+int width_supports(program* p);
+
+// Width specialized version of program_run_range. There is one kernel per
+// number of bits (1 to WIDTH_MAX_BITS), built from width_kernel.h with the
+// mask as a constant and 8 bit registers. The kernel for p->bits (-b on the
+// command line) is used. start must be a multiple of WIDTH_BLOCK.
+void width_run_range(program* p, uint64_t start, uint64_t count, int32_t* values, uint8_t* nan);
+
+#endif
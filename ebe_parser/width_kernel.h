@@ -0,0 +1,128 @@
+// Width specialized kernel template, included by width.c once per number of
+// bits. Before including define:
+//
+// WIDTH_KERNEL_NAME  name of the kernel function
+// WIDTH_BITS         number of bits in every variable
+// WIDTH_TYPE         unsigned integer type holding one value
+//
+// The kernel has the signature of program_run_range. Each instruction is run
+// over a block of WIDTH_BLOCK assignments at a time, so the loops below have
+// no dependency between iterations, and the compiler can vectorize them.
+
+static void WIDTH_KERNEL_NAME(program* p, uint64_t start, uint64_t count, int32_t* values, uint8_t* nan)
+{
+	typedef WIDTH_TYPE width_t;
+
+	const width_t mask = (width_t)((1u << WIDTH_BITS) - 1);
+
+	size_t n = p->variable_count;
+
+	width_t* regs;
+	uint8_t nan_block[WIDTH_BLOCK];
+
+	width_t* r;
+	width_t* a;
+	width_t* b;
+	instruction* in;
+
+	uint64_t block;
+	uint64_t end = start + count;
+	uint32_t shift;
+	size_t i, j, m;
+
+	if (start % WIDTH_BLOCK != 0)
+	{
+		elog(LOG_FATAL_ERROR, "width_run_range: start (%d) is not a multiple of %d\n", (int)start, WIDTH_BLOCK);
+	}
+
+	regs = (width_t*)malloc(sizeof(width_t) * WIDTH_BLOCK * p->length);
+
+	if (regs == 0)
+	{
+		elog(LOG_FATAL_ERROR, "width_run_range: out of memory\n");
+	}
+
+	for (block = start; block < end; block += WIDTH_BLOCK)
+	{
+		m = end - block < WIDTH_BLOCK ? (size_t)(end - block) : WIDTH_BLOCK;
+
+		memset(nan_block, 0, sizeof(uint8_t) * WIDTH_BLOCK);
+
+		for (i=0; i<p->length; i++)
+		{
+			in = &p->code[i];
+			r = regs + i * WIDTH_BLOCK;
+			a = regs + in->a * WIDTH_BLOCK;
+			b = regs + in->b * WIDTH_BLOCK;
+
+			switch (in->op)
+			{
+				case op_const:
+					for (j=0; j<m; j++) r[j] = (width_t)in->a;
+					break;
+				case op_var:
+					shift = WIDTH_BITS * (uint32_t)(n - 1 - in->a);
+					for (j=0; j<m; j++) r[j] = shift < 64 ? (width_t)((block + j) >> shift) & mask : 0;
+					break;
+				case op_mul:
+					for (j=0; j<m; j++) r[j] = (width_t)(a[j] * b[j]) & mask;
+					break;
+				case op_div:
+					for (j=0; j<m; j++)
+					{
+						nan_block[j] |= b[j] == 0;
+						r[j] = b[j] == 0 ? 0 : a[j] / b[j];
+					}
+					break;
+				case op_mod:
+					for (j=0; j<m; j++)
+					{
+						nan_block[j] |= b[j] == 0;
+						r[j] = b[j] == 0 ? 0 : a[j] % b[j];
+					}
+					break;
+				case op_add:
+					for (j=0; j<m; j++) r[j] = (width_t)(a[j] + b[j]) & mask;
+					break;
+				case op_sub:
+					for (j=0; j<m; j++) r[j] = (width_t)(a[j] - b[j]) & mask;
+					break;
+				// every bit is shifted out once the amount reaches the width
+				case op_shl:
+					for (j=0; j<m; j++) r[j] = b[j] < WIDTH_BITS ? (width_t)(a[j] << b[j]) & mask : 0;
+					break;
+				case op_shr:
+					for (j=0; j<m; j++) r[j] = b[j] < WIDTH_BITS ? a[j] >> b[j] : 0;
+					break;
+				case op_and:
+					for (j=0; j<m; j++) r[j] = a[j] & b[j];
+					break;
+				case op_xor:
+					for (j=0; j<m; j++) r[j] = a[j] ^ b[j];
+					break;
+				case op_or:
+					for (j=0; j<m; j++) r[j] = a[j] | b[j];
+					break;
+				case op_minus:
+					for (j=0; j<m; j++) r[j] = (width_t)(0 - a[j]) & mask;
+					break;
+				case op_negate:
+					for (j=0; j<m; j++) r[j] = (width_t)~a[j] & mask;
+					break;
+				default:
+					for (j=0; j<m; j++) r[j] = 0;
+					break;
+			}
+		}
+
+		r = regs + (p->length - 1) * WIDTH_BLOCK;
+
+		for (j=0; j<m; j++)
+		{
+			values[block - start + j] = (int32_t)r[j];
+			nan[block - start + j] = nan_block[j];
+		}
+	}
+
+	free(regs);
+}